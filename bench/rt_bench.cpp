@@ -0,0 +1,329 @@
+/**
+ * @file    rt_bench.cpp
+ *
+ * Renders a fixed suite of scenes with Final, headless and at fixed sizes,
+ * seeds and sample counts, and writes the timings to JSON so runs can be
+ * compared across commits.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "image.h"
+#include "suite.h"
+
+#if defined(_WIN32) || defined(_WIN64)
+#include <direct.h>
+#define popen _popen
+#define pclose _pclose
+#define mkdir(dir, mode) _mkdir(dir)
+#else
+#include <sys/stat.h>
+#endif
+
+// Snapshots taken over a run to find when it reached the target error
+#define BENCH_SNAPSHOTS 16
+
+struct BenchResult {
+    FinalRun run;
+    double rmse;
+    double target_time;
+    int target_spp;
+
+    // Runs of each of bench_variants with --variants and of bench_mappings
+    // with --mappings, else empty
+    std::vector<FinalRun> variants;
+    std::vector<FinalRun> mappings;
+};
+
+// RMSE of an image file against a reference, -1 if it cannot be loaded
+double image_rmse(const char* file, const Image &reference) {
+    Image image;
+    if (image.load(file)) {
+        return -1.0;
+    }
+    return image.rmse(reference);
+}
+
+// Rays a run traced, estimated from its path lengths if Final did not count
+// them (the shadow rays are missing then)
+double run_rays(const FinalRun &run) {
+    return run.rays > 0.0 ? run.rays : run.paths * (1.0 + run.bounces);
+}
+
+// First line a shell command prints, empty if it fails
+std::string command_line(const char* command) {
+    std::string line;
+    FILE* pipe = popen(command, "r");
+    if (!pipe) {
+        return line;
+    }
+
+    char buffer[256];
+    if (fgets(buffer, sizeof(buffer), pipe)) {
+        line = buffer;
+        line.erase(line.find_last_not_of("\r\n") + 1);
+    }
+    return pclose(pipe) == 0 ? line : std::string();
+}
+
+// Writes a string to JSON, escaping what JSON needs escaped
+void json_string(FILE* f, const std::string &s) {
+    fputc('"', f);
+    for (char c : s) {
+        if (c == '"' || c == '\\') {
+            fputc('\\', f);
+        }
+        if ((unsigned char) c >= 0x20) {
+            fputc(c, f);
+        }
+    }
+    fputc('"', f);
+}
+
+// Writes a number, or null when it is not known (negative)
+void json_number(FILE* f, double value) {
+    if (value < 0.0 || !std::isfinite(value)) {
+        fprintf(f, "null");
+    } else {
+        fprintf(f, "%.6g", value);
+    }
+}
+
+// Writes the runs of a variant table, the speedups are over its first entry
+void json_variants(FILE* f, const char* key, const BenchVariant* table, const std::vector<FinalRun> &runs) {
+    if (runs.empty()) {
+        return;
+    }
+
+    fprintf(f, ",\n      \"%s\": [\n", key);
+    for (size_t j = 0; j < runs.size(); j++) {
+        const FinalRun &v = runs[j];
+        bool timed = v.ok && v.render > 0.0;
+        fprintf(f, "        { \"name\": ");
+        json_string(f, table[j].name);
+        fprintf(f, ", \"options\": ");
+        json_string(f, table[j].options);
+        fprintf(f, ", \"render_seconds\": ");
+        json_number(f, v.ok ? v.render : -1.0);
+        fprintf(f, ", \"mrays_per_second\": ");
+        json_number(f, timed ? run_rays(v) / v.render / 1e6 : -1.0);
+        fprintf(f, ", \"speedup\": ");
+        json_number(f, timed && runs[0].ok ? runs[0].render / v.render : -1.0);
+        fprintf(f, " }%s\n", j + 1 < runs.size() ? "," : "");
+    }
+    fprintf(f, "      ]");
+}
+
+// Renders a scene once with each variant of a table and prints the Mrays/s
+// of each and its speedup over the first. Compiling the kernels is not
+// part of the render time.
+std::vector<FinalRun> run_variants(const char* final_path, const BenchScene &scene, const std::string &file,
+                                   const BenchVariant* table, int count) {
+    std::vector<FinalRun> runs;
+    for (int j = 0; j < count; j++) {
+        FinalRun run;
+        if (!run_final(final_path, scene, scene.spp, file.c_str(), 0, run, table[j].options) && run.render > 0.0) {
+            const FinalRun &first = runs.empty() ? run : runs[0];
+            printf("[Bench] - %s %s: %.2f Mrays/s, %.2fx\n", scene.name, table[j].name,
+                   run_rays(run) / run.render / 1e6, first.ok ? first.render / run.render : 0.0);
+            fflush(stdout);
+        }
+        runs.push_back(run);
+        remove(file.c_str());
+    }
+    return runs;
+}
+
+int write_json(const char* file, const std::string &commit, const std::vector<const BenchScene*> &scenes,
+               const std::vector<BenchResult> &results) {
+    FILE* f = fopen(file, "w");
+    if (!f) {
+        fprintf(stderr, "ERROR: Unable to write %s!\n", file);
+        return -1;
+    }
+
+    std::string renderer;
+    for (const BenchResult &r : results) {
+        if (!r.run.renderer.empty()) {
+            renderer = r.run.renderer;
+        }
+    }
+
+    fprintf(f, "{\n  \"commit\": ");
+    json_string(f, commit);
+    fprintf(f, ",\n  \"renderer\": ");
+    json_string(f, renderer);
+    fprintf(f, ",\n  \"seed\": %d,\n  \"reference_seed\": %d,\n  \"depth\": %d,\n  \"scenes\": [\n",
+            BENCH_SEED, REFERENCE_SEED, BENCH_DEPTH);
+    for (size_t i = 0; i < scenes.size(); i++) {
+        const BenchScene &s = *scenes[i];
+        const FinalRun &r = results[i].run;
+        double samples = double(s.width) * double(s.height) * double(s.spp);
+        double rays = run_rays(r);
+
+        fprintf(f, "    {\n      \"name\": ");
+        json_string(f, s.name);
+        fprintf(f, ",\n      \"scene\": ");
+        json_string(f, s.file);
+        fprintf(f, ",\n      \"ok\": %s,\n", r.ok ? "true" : "false");
+        fprintf(f, "      \"width\": %d,\n      \"height\": %d,\n      \"spp\": %d,\n", s.width, s.height, s.spp);
+        fprintf(f, "      \"wall_seconds\": ");
+        json_number(f, r.ok ? r.wall : -1.0);
+        fprintf(f, ",\n      \"startup_seconds\": ");
+        json_number(f, r.ok ? r.wall - r.render : -1.0);
+        fprintf(f, ",\n      \"render_seconds\": ");
+        json_number(f, r.ok ? r.render : -1.0);
+        fprintf(f, ",\n      \"samples_per_second\": ");
+        json_number(f, r.ok && r.render > 0.0 ? samples / r.render : -1.0);
+        fprintf(f, ",\n      \"mrays_per_second\": ");
+        json_number(f, r.ok && r.render > 0.0 ? rays / r.render / 1e6 : -1.0);
+        fprintf(f, ",\n      \"rmse\": ");
+        json_number(f, results[i].rmse);
+        fprintf(f, ",\n      \"target_rmse\": ");
+        json_number(f, s.target_rmse);
+        fprintf(f, ",\n      \"seconds_to_target\": ");
+        json_number(f, results[i].target_time);
+        fprintf(f, ",\n      \"spp_to_target\": ");
+        json_number(f, results[i].target_time >= 0.0 ? double(results[i].target_spp) : -1.0);
+        json_variants(f, "variants", bench_variants, results[i].variants);
+        json_variants(f, "mappings", bench_mappings, results[i].mappings);
+        fprintf(f, "\n    }%s\n", i + 1 < scenes.size() ? "," : "");
+    }
+    fprintf(f, "  ]\n}\n");
+    fclose(f);
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    const char* final_path = FINAL_PATH;
+    const char* output = "rt_bench.json";
+    std::string references = REFERENCE_DIR;
+    const char* only = NULL;
+    bool update = false;
+    bool variants = false;
+    bool mappings = false;
+
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--final") && i + 1 < argc) {
+            final_path = argv[++i];
+        } else if (!strcmp(argv[i], "--output") && i + 1 < argc) {
+            output = argv[++i];
+        } else if (!strcmp(argv[i], "--references") && i + 1 < argc) {
+            references = argv[++i];
+        } else if (!strcmp(argv[i], "--scene") && i + 1 < argc) {
+            only = argv[++i];
+        } else if (!strcmp(argv[i], "--update-references")) {
+            update = true;
+        } else if (!strcmp(argv[i], "--variants")) {
+            variants = true;
+        } else if (!strcmp(argv[i], "--mappings")) {
+            mappings = true;
+        } else {
+            fprintf(stderr, "Usage: %s [--final PATH] [--output FILE] [--references DIR] [--scene NAME] [--update-references] "
+                            "[--variants] [--mappings]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    std::vector<const BenchScene*> scenes = select_scenes(only);
+    if (scenes.empty()) {
+        fprintf(stderr, "ERROR: No scene named %s in the suite\n", only);
+        return 1;
+    }
+
+    // References are only rendered on request, they take a long time
+    if (update) {
+        mkdir(references.c_str(), 0755);
+        int failed = 0;
+        for (const BenchScene* scene : scenes) {
+            std::string file = reference_file(references, *scene);
+            printf("[Bench] - rendering the %s reference at %d spp\n", scene->name, scene->spp * REFERENCE_SCALE);
+            fflush(stdout);
+
+            FinalRun run;
+            if (run_final(final_path, *scene, scene->spp * REFERENCE_SCALE, file.c_str(), 0, run, NULL, REFERENCE_SEED)) {
+                failed++;
+                continue;
+            }
+            printf("[Bench] - wrote %s in %.1f s\n", file.c_str(), run.wall);
+        }
+        return failed ? 1 : 0;
+    }
+
+    std::vector<BenchResult> results;
+    for (const BenchScene* scene : scenes) {
+        printf("[Bench] - %s, %dx%d at %d spp\n", scene->name, scene->width, scene->height, scene->spp);
+        fflush(stdout);
+
+        std::string file = std::string("rt_bench_") + scene->name + ".pfm";
+        int snapshot_every = std::max(1, scene->spp / scene->samples / BENCH_SNAPSHOTS);
+        BenchResult result;
+        result.rmse = -1.0;
+        result.target_time = -1.0;
+        result.target_spp = 0;
+        run_final(final_path, *scene, scene->spp, file.c_str(), snapshot_every, result.run);
+        const FinalRun &run = result.run;
+
+        // Error of the final image and of each snapshot, the first one under
+        // the target tells how long it took to get there
+        Image reference;
+        if (run.ok && !load_reference(references, *scene, reference)) {
+            result.rmse = image_rmse(file.c_str(), reference);
+            for (const Snapshot &snapshot : run.snapshots) {
+                double rmse = image_rmse(snapshot.file.c_str(), reference);
+                if (rmse >= 0.0 && rmse <= scene->target_rmse) {
+                    result.target_time = snapshot.seconds;
+                    result.target_spp = snapshot.spp;
+                    break;
+                }
+            }
+        }
+        for (const Snapshot &snapshot : run.snapshots) {
+            remove(snapshot.file.c_str());
+        }
+        remove(file.c_str());
+
+        if (run.ok) {
+            double samples = double(scene->width) * double(scene->height) * double(scene->spp);
+            double rays = run_rays(run);
+            printf("[Bench] - %.2f Mrays/s, %.2f M samples/s, %.3f s wall, %.3f s startup",
+                   rays / run.render / 1e6, samples / run.render / 1e6, run.wall, run.wall - run.render);
+            if (result.rmse >= 0.0) {
+                printf(", rmse %.5f", result.rmse);
+            }
+            if (result.target_time >= 0.0) {
+                printf(", rmse %.3f after %.3f s", scene->target_rmse, result.target_time);
+            }
+            printf("\n");
+        }
+
+        // The same render with each specialization of the kernels and each
+        // mapping of samples to invocations
+        if (variants) {
+            result.variants = run_variants(final_path, *scene, file, bench_variants, BENCH_VARIANTS);
+        }
+        if (mappings) {
+            result.mappings = run_variants(final_path, *scene, file, bench_mappings, BENCH_MAPPINGS);
+        }
+        results.push_back(result);
+    }
+
+    std::string commit = command_line("git describe --always --dirty 2>&1");
+    if (write_json(output, commit, scenes, results)) {
+        return 1;
+    }
+    printf("[Bench] - wrote %s\n", output);
+
+    for (const BenchResult &result : results) {
+        if (!result.run.ok) {
+            return 1;
+        }
+    }
+    return 0;
+}
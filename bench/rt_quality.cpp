@@ -0,0 +1,187 @@
+/**
+ * @file    rt_quality.cpp
+ *
+ * Renders the benchmark suite at its fixed seed and sample count and
+ * compares every image against the scene's high sample count reference,
+ * which rt_bench renders with REFERENCE_SEED so the two share no noise.
+ * A scene regresses when its error grows past a tolerance over the stored
+ * baseline of an accepted build, or its mean drifts away from the
+ * reference, so speedups can be checked to keep the image the same.
+ */
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "image.h"
+#include "suite.h"
+
+// How a render compares to its reference
+struct Quality {
+    double rmse;
+    double relative_mse;
+    double ssim;
+    double mean;
+};
+
+std::string baseline_file(const std::string &dir, const BenchScene &scene) {
+    return dir + "/" + scene.name + ".quality";
+}
+
+int load_baseline(const std::string &file, Quality &q) {
+    FILE* f = fopen(file.c_str(), "r");
+    if (!f) {
+        return -1;
+    }
+    int n = fscanf(f, "rmse %lf relative_mse %lf ssim %lf mean %lf", &q.rmse, &q.relative_mse, &q.ssim, &q.mean);
+    fclose(f);
+    if (n != 4) {
+        fprintf(stderr, "ERROR: %s is not a quality baseline!\n", file.c_str());
+        return -1;
+    }
+    return 0;
+}
+
+int save_baseline(const std::string &file, const Quality &q) {
+    FILE* f = fopen(file.c_str(), "w");
+    if (!f) {
+        fprintf(stderr, "ERROR: Unable to write %s!\n", file.c_str());
+        return -1;
+    }
+    fprintf(f, "rmse %.9g\nrelative_mse %.9g\nssim %.9g\nmean %.9g\n", q.rmse, q.relative_mse, q.ssim, q.mean);
+    fclose(f);
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    const char* final_path = FINAL_PATH;
+    std::string references = REFERENCE_DIR;
+    const char* only = NULL;
+    bool update = false;
+
+    // Allowed growth of the RMSE (the relative MSE may grow by its
+    // square), drop of the SSIM and relative drift of the mean
+    double tolerance = 0.05;
+    double ssim_tolerance = 0.005;
+    double bias_tolerance = 0.01;
+
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--final") && i + 1 < argc) {
+            final_path = argv[++i];
+        } else if (!strcmp(argv[i], "--references") && i + 1 < argc) {
+            references = argv[++i];
+        } else if (!strcmp(argv[i], "--scene") && i + 1 < argc) {
+            only = argv[++i];
+        } else if (!strcmp(argv[i], "--tolerance") && i + 1 < argc) {
+            tolerance = atof(argv[++i]);
+        } else if (!strcmp(argv[i], "--ssim-tolerance") && i + 1 < argc) {
+            ssim_tolerance = atof(argv[++i]);
+        } else if (!strcmp(argv[i], "--bias-tolerance") && i + 1 < argc) {
+            bias_tolerance = atof(argv[++i]);
+        } else if (!strcmp(argv[i], "--update-baseline")) {
+            update = true;
+        } else {
+            fprintf(stderr, "Usage: %s [--final PATH] [--references DIR] [--scene NAME] [--tolerance T] "
+                            "[--ssim-tolerance T] [--bias-tolerance T] [--update-baseline]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    std::vector<const BenchScene*> scenes = select_scenes(only);
+    if (scenes.empty()) {
+        fprintf(stderr, "ERROR: No scene named %s in the suite\n", only);
+        return 1;
+    }
+
+    int failed = 0;
+    for (const BenchScene* scene : scenes) {
+        Image reference;
+        if (load_reference(references, *scene, reference)) {
+            fprintf(stderr, "ERROR: %s has no reference, render it with rt_bench --update-references\n",
+                    reference_file(references, *scene).c_str());
+            failed++;
+            continue;
+        }
+
+        std::string file = std::string("rt_quality_") + scene->name + ".pfm";
+        FinalRun run;
+        Image image;
+        if (run_final(final_path, *scene, scene->spp, file.c_str(), 0, run) || image.load(file.c_str())) {
+            failed++;
+            continue;
+        }
+        remove(file.c_str());
+
+        Quality q;
+        q.rmse = image.rmse(reference);
+        q.relative_mse = image.relative_mse(reference);
+        q.ssim = image.ssim(reference);
+        q.mean = image.mean();
+        if (q.rmse < 0.0) {
+            fprintf(stderr, "ERROR: %s is %dx%d, the reference is %dx%d\n", scene->name,
+                    image.width, image.height, reference.width, reference.height);
+            failed++;
+            continue;
+        }
+
+        double reference_mean = reference.mean();
+        double bias = reference_mean > 0.0 ? fabs(q.mean - reference_mean) / reference_mean : 0.0;
+        printf("[Quality] - %s: rmse %.5f, relative mse %.6f, ssim %.4f, mean %.5f (reference %.5f)\n",
+               scene->name, q.rmse, q.relative_mse, q.ssim, q.mean, reference_mean);
+
+        std::string baseline = baseline_file(references, *scene);
+        if (update) {
+            if (save_baseline(baseline, q)) {
+                failed++;
+            } else {
+                printf("[Quality] - wrote %s\n", baseline.c_str());
+            }
+            continue;
+        }
+
+        // The mean needs no baseline, noise barely moves it at this many
+        // samples but a biased change does
+        std::vector<std::string> regressions;
+        char reason[128];
+        if (bias > bias_tolerance) {
+            snprintf(reason, sizeof(reason), "mean off the reference by %.2f%%", bias * 100.0);
+            regressions.push_back(reason);
+        }
+
+        Quality base;
+        if (load_baseline(baseline, base)) {
+            printf("[Quality] - %s has no baseline, record one with --update-baseline\n", scene->name);
+        } else {
+            if (q.rmse > base.rmse * (1.0 + tolerance)) {
+                snprintf(reason, sizeof(reason), "rmse up %.2f%% from %.5f", (q.rmse / base.rmse - 1.0) * 100.0, base.rmse);
+                regressions.push_back(reason);
+            }
+            if (q.relative_mse > base.relative_mse * (1.0 + tolerance) * (1.0 + tolerance)) {
+                snprintf(reason, sizeof(reason), "relative mse up %.2f%% from %.6f",
+                         (q.relative_mse / base.relative_mse - 1.0) * 100.0, base.relative_mse);
+                regressions.push_back(reason);
+            }
+            if (q.ssim < base.ssim - ssim_tolerance) {
+                snprintf(reason, sizeof(reason), "ssim down %.4f from %.4f", base.ssim - q.ssim, base.ssim);
+                regressions.push_back(reason);
+            }
+        }
+
+        for (const std::string &r : regressions) {
+            printf("[Quality] - %s REGRESSED: %s\n", scene->name, r.c_str());
+        }
+        if (!regressions.empty()) {
+            failed++;
+        }
+    }
+
+    if (failed) {
+        printf("[Quality] - %d of %d scenes failed\n", failed, (int) scenes.size());
+        return 1;
+    }
+    printf("[Quality] - all %d scenes passed\n", (int) scenes.size());
+    return 0;
+}
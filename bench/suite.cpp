@@ -0,0 +1,116 @@
+#include "suite.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#if defined(_WIN32) || defined(_WIN64)
+#define popen _popen
+#define pclose _pclose
+#endif
+
+static const BenchScene suite[] = {
+    { "cornell", "cornell.scene", 512, 256, 8, 256, 0.02 },
+    { "spheres", "spheres.scene", 512, 256, 8, 256, 0.02 },
+    { "mesh",    "mesh.scene",    512, 256, 8, 256, 0.02 },
+};
+
+const BenchVariant bench_variants[BENCH_VARIANTS] = {
+    { "none",       "--specialize none" },
+    { "depth",      "--specialize depth" },
+    { "materials",  "--specialize materials" },
+    { "resolution", "--specialize resolution" },
+    { "all",        "--specialize all" },
+};
+
+const BenchVariant bench_mappings[BENCH_MAPPINGS] = {
+    { "per-pixel",      "" },
+    { "persistent-16",  "--persistent 16" },
+    { "persistent-64",  "--persistent 64" },
+    { "persistent-256", "--persistent 256" },
+};
+
+std::vector<const BenchScene*> select_scenes(const char* name) {
+    std::vector<const BenchScene*> scenes;
+    for (const BenchScene &scene : suite) {
+        if (!name || !strcmp(name, scene.name)) {
+            scenes.push_back(&scene);
+        }
+    }
+    return scenes;
+}
+
+int run_final(const char* final_path, const BenchScene &scene, int spp, const char* output,
+              int snapshot_every, FinalRun &run, const char* options, int seed) {
+    char command[1024];
+    int n = snprintf(command, sizeof(command),
+        "\"%s\" %d %d --headless --scene %s --size %dx%d --seed %d --spp %d --adaptive 0 --output %s",
+        final_path, scene.samples, BENCH_DEPTH, scene.file, scene.width, scene.height, seed, spp, output);
+    if (snapshot_every > 0) {
+        n += snprintf(command + n, sizeof(command) - n, " --snapshot %d", snapshot_every);
+    }
+    if (options && options[0]) {
+        n += snprintf(command + n, sizeof(command) - n, " %s", options);
+    }
+    snprintf(command + n, sizeof(command) - n, " 2>&1");
+
+    run = FinalRun();
+    auto start = std::chrono::steady_clock::now();
+    FILE* pipe = popen(command, "r");
+    if (!pipe) {
+        fprintf(stderr, "ERROR: Failed to run %s\n", command);
+        return -1;
+    }
+
+    bool finished = false;
+    char line[1024];
+    while (fgets(line, sizeof(line), pipe)) {
+        char file[512];
+        const char* renderer = strstr(line, " context on ");
+        int taken;
+        double seconds, paths, bounces, rays, primary;
+        if (sscanf(line, "[Batch] - %d spp in %lf s", &taken, &seconds) == 2) {
+            run.render = seconds;
+            finished = true;
+        } else if (sscanf(line, "[Paths] - %lf paths, %lf bounces", &paths, &bounces) == 2) {
+            run.paths = paths;
+            run.bounces = bounces;
+        } else if (sscanf(line, "[Rays] - %lf rays, %lf primary", &rays, &primary) == 2) {
+            run.rays = rays;
+        } else if (sscanf(line, "[Snapshot] - %511s at %lf s", file, &seconds) == 2) {
+            const char* suffix = strrchr(file, '_');
+            run.snapshots.push_back({ file, seconds, suffix ? atoi(suffix + 1) : 0 });
+        } else if (renderer) {
+            run.renderer = renderer + strlen(" context on ");
+            run.renderer.erase(run.renderer.find_last_not_of("\r\n") + 1);
+        } else if (strstr(line, "ERROR") || strstr(line, "error")) {
+            fputs(line, stderr);
+        }
+    }
+    int status = pclose(pipe);
+    std::chrono::duration<double> wall = std::chrono::steady_clock::now() - start;
+    run.wall = wall.count();
+
+    if (status != 0 || !finished) {
+        fprintf(stderr, "ERROR: %s failed with status %d\n", command, status);
+        return -1;
+    }
+    run.ok = true;
+    return 0;
+}
+
+std::string reference_file(const std::string &dir, const BenchScene &scene) {
+    return dir + "/" + scene.name + ".pfm";
+}
+
+int load_reference(const std::string &dir, const BenchScene &scene, Image &reference) {
+    // Missing references are expected, only complain about broken ones
+    std::string file = reference_file(dir, scene);
+    FILE* f = fopen(file.c_str(), "rb");
+    if (!f) {
+        return -1;
+    }
+    fclose(f);
+    return reference.load(file.c_str());
+}
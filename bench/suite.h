@@ -0,0 +1,115 @@
+#ifndef _SUITE_H_
+#define _SUITE_H_
+
+#include <string>
+#include <vector>
+
+#include "image.h"
+
+#ifndef FINAL_PATH
+#define FINAL_PATH "./Final"
+#endif
+
+#ifndef REFERENCE_DIR
+#define REFERENCE_DIR "references"
+#endif
+
+#define BENCH_SEED 1
+#define BENCH_DEPTH 20
+
+// References are rendered with their own seed, so their noise is
+// independent of the runs measured against them
+#define REFERENCE_SEED 2
+
+// References are rendered with this many times the samples of a run
+#define REFERENCE_SCALE 64
+
+// A scene of the suite, every pixel takes spp samples, samples per frame
+struct BenchScene {
+    const char* name;
+    const char* file;
+    int width;
+    int height;
+    int samples;
+    int spp;
+    double target_rmse;
+};
+
+// An image saved while rendering, after spp samples per pixel
+struct Snapshot {
+    std::string file;
+    double seconds;
+    int spp;
+};
+
+// A way of running Final that runs can compare, by the options it adds
+struct BenchVariant {
+    const char* name;
+    const char* options;
+};
+
+// Specializations of the tracing kernels, the first one unspecialized
+#define BENCH_VARIANTS 5
+extern const BenchVariant bench_variants[BENCH_VARIANTS];
+
+// Mappings of samples to invocations, the first one a pixel per invocation
+#define BENCH_MAPPINGS 4
+extern const BenchVariant bench_mappings[BENCH_MAPPINGS];
+
+// What a run of Final reported
+struct FinalRun {
+    bool ok;
+    double wall;
+    double render;
+    double paths;
+    double bounces;
+    double rays;
+    std::string renderer;
+    std::vector<Snapshot> snapshots;
+};
+
+/**
+ * Picks scenes of the suite by name.
+ *
+ * @param name  Name of the scene, NULL for all of them
+ * @return  The matching scenes, empty if none has the name.
+ */
+std::vector<const BenchScene*> select_scenes(const char* name);
+
+/**
+ * Renders a scene with Final, headless, at the suite's depth and without
+ * adaptive sampling, and collects what it prints.
+ *
+ * @param final_path        Path of the Final executable
+ * @param scene             Scene to render
+ * @param spp               Samples per pixel
+ * @param output            Image file to save the result to
+ * @param snapshot_every    Frames between snapshots, 0 for none
+ * @param run               Receives the timings and snapshots
+ * @param options           More options to pass, NULL for none
+ * @param seed              Scrambling seed of the samples
+ * @return  0 if success, else -1.
+ */
+int run_final(const char* final_path, const BenchScene &scene, int spp, const char* output,
+              int snapshot_every, FinalRun &run, const char* options = NULL, int seed = BENCH_SEED);
+
+/**
+ * Gets the file of a scene's reference image.
+ *
+ * @param dir       Directory of the references
+ * @param scene     Scene of the reference
+ * @return  Path of the .pfm file.
+ */
+std::string reference_file(const std::string &dir, const BenchScene &scene);
+
+/**
+ * Loads a scene's reference image, if it has been rendered.
+ *
+ * @param dir           Directory of the references
+ * @param scene         Scene of the reference
+ * @param reference     Receives the reference
+ * @return  0 if success, else -1.
+ */
+int load_reference(const std::string &dir, const BenchScene &scene, Image &reference);
+
+#endif
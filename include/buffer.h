@@ -0,0 +1,100 @@
+#ifndef _BUFFER_H_
+#define _BUFFER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <GLFW/glfw3.h>
+#include <GL/glew.h>
+
+class Buffer {
+public:
+    GLuint m_buffer;
+    GLenum m_target;
+    size_t m_size;
+    void* m_mapped;
+public:
+
+    /**
+     * Creates a new Buffer object. No GL buffer exists until the first
+     * upload.
+     *
+     * @param target    Buffer binding target, e.g. GL_SHADER_STORAGE_BUFFER
+     */
+    Buffer(GLenum target = GL_SHADER_STORAGE_BUFFER);
+
+    /**
+     * Destroys the Buffer object
+     */
+    ~Buffer();
+
+    /**
+     * Replaces the contents of the buffer.
+     *
+     * @param data      Data to upload, may be NULL to only allocate
+     * @param size      Size of the data in bytes
+     * @param usage     Usage hint
+     */
+    void upload(const void* data, size_t size, GLenum usage = GL_STATIC_DRAW);
+
+    /**
+     * Allocates immutable storage that stays mapped for writing for the
+     * lifetime of the buffer and copies data straight into the mapping.
+     * Falls back to upload() without GL 4.4 / ARB_buffer_storage.
+     *
+     * @param data      Data to copy, may be NULL to only allocate
+     * @param size      Size of the data in bytes
+     * @return  Pointer to the persistent mapping, or NULL on fallback.
+     */
+    void* storage(const void* data, size_t size);
+
+    /**
+     * Binds the buffer to an indexed binding point of its target.
+     *
+     * @param slot      Binding point used in the shader.
+     */
+    void bind(unsigned int slot);
+
+    /**
+     * Overwrites part of the buffer without reallocating it.
+     *
+     * @param data      Data to copy
+     * @param size      Number of bytes to write
+     * @param offset    Byte offset into the buffer
+     */
+    void write(const void* data, size_t size, size_t offset = 0);
+
+    /**
+     * Zeroes part of the buffer on the GPU.
+     *
+     * @param size      Number of bytes to clear, a multiple of 4
+     * @param offset    Byte offset into the buffer, a multiple of 4
+     */
+    void zero(size_t size, size_t offset = 0);
+
+    /**
+     * Copies part of the buffer back to the host. Shader writes must be
+     * made visible with GL_BUFFER_UPDATE_BARRIER_BIT first.
+     *
+     * @param data      Destination
+     * @param size      Number of bytes to read
+     * @param offset    Byte offset into the buffer
+     */
+    void read(void* data, size_t size, size_t offset = 0);
+
+    /**
+     * Copies part of another buffer into this one on the GPU, without a
+     * round trip through the host.
+     *
+     * @param src           Buffer to copy from
+     * @param size          Number of bytes to copy
+     * @param src_offset    Byte offset into src
+     * @param offset        Byte offset into this buffer
+     */
+    void copy(const Buffer &src, size_t size, size_t src_offset = 0, size_t offset = 0);
+
+private:
+    void release();
+};
+
+#endif
@@ -0,0 +1,118 @@
+#ifndef _BVH_H_
+#define _BVH_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <vector>
+
+#include "vector.h"
+
+// Primitive references pack the primitive index and kind as (index << 2) | kind
+enum PrimitiveKind {
+    PRIM_SPHERE = 0,
+    PRIM_RECT = 1,
+    PRIM_TRIANGLE = 2
+};
+
+#define PRIM_KIND(ref)  ((ref) & 3)
+#define PRIM_INDEX(ref) ((ref) >> 2)
+#define PRIM_REF(kind, index) (((index) << 2) | (kind))
+
+#define BVH_MAX_DEPTH   64
+#define BVH_MAX_LEAF    4
+#define BVH_BINS        16
+
+struct AABB {
+    vec3 min;
+    vec3 max;
+
+    AABB() : min(INFINITY), max(-INFINITY) {}
+    AABB(const vec3 &a, const vec3 &b) : min(a), max(b) {}
+
+    void grow(const vec3 &p) {
+        for (int i = 0; i < 3; i++) {
+            min[i] = fminf(min[i], p[i]);
+            max[i] = fmaxf(max[i], p[i]);
+        }
+    }
+
+    void grow(const AABB &box) {
+        for (int i = 0; i < 3; i++) {
+            min[i] = fminf(min[i], box.min[i]);
+            max[i] = fmaxf(max[i], box.max[i]);
+        }
+    }
+
+    vec3 center() const {
+        return 0.5f * (min + max);
+    }
+
+    float area() const {
+        vec3 d = max - min;
+        if (d[0] < 0.0f || d[1] < 0.0f || d[2] < 0.0f) {
+            return 0.0f;
+        }
+        return 2.0f * (d[0] * d[1] + d[1] * d[2] + d[2] * d[0]);
+    }
+};
+
+/**
+ * Flattened BVH node, laid out to match the std430 bvh_node struct in
+ * raytracer.comp. Interior nodes (count == 0) store their left child
+ * directly after themselves and the right child at index next. Leaves
+ * store count primitive references starting at prims[next].
+ */
+struct BVHNode {
+    float min[3];
+    int32_t next;
+    float max[3];
+    int32_t count;
+};
+
+class BVH {
+public:
+    std::vector<BVHNode> nodes;
+    std::vector<int32_t> prims;
+
+public:
+
+    /**
+     * Builds a binned SAH BVH over a set of primitives.
+     *
+     * @param boxes     Bounds of each primitive
+     * @param refs      Packed primitive reference stored for each primitive
+     */
+    void build(const std::vector<AABB> &boxes, const std::vector<int32_t> &refs);
+
+    /**
+     * Copies the BVH onto the end of shared node and primitive arrays,
+     * offsetting its indices to match.
+     *
+     * @param nodes     Node array to append to
+     * @param prims     Primitive array to append to
+     * @return  Index of the root node in nodes.
+     */
+    int32_t append(std::vector<BVHNode> &nodes, std::vector<int32_t> &prims) const;
+
+private:
+    struct Build {
+        AABB box;
+        vec3 center;
+        int32_t ref;
+    };
+
+    int32_t build_node(std::vector<Build> &items, int begin, int end, int depth);
+};
+
+/**
+ * Measures a flattened BVH.
+ *
+ * @param nodes     Node array
+ * @param count     Number of nodes in the array
+ * @param root      Index of the root node
+ * @return  Depth of the deepest leaf, -1 if a node is out of range.
+ */
+int bvh_depth(const BVHNode* nodes, size_t count, int32_t root);
+
+#endif
@@ -1,9 +1,20 @@
 #ifndef _CAMERA_H_
 #define _CAMERA_H_
 
-#include "shader.h"
 #include "vector.h"
 
+// The camera struct of tracer.glsl in a std140 uniform block, every vec3
+// padded to 16 bytes except the last, which lens completes
+struct CameraBlock {
+    float lower_left[4];
+    float right[4];
+    float up[4];
+    float origin[4];
+    float u[4];
+    float v[3];
+    float lens;
+};
+
 class Camera {
     private:
         vec3 origin;
@@ -43,11 +54,24 @@ class Camera {
         void update(vec3 position, vec3 lookat, vec3 up);
 
         /**
-         *  Updates a shader with the camera data.
-         * 
-         *  @param  shader  Shader to update unforms for
+         *  Writes the camera data in the layout the shaders read it in.
+         *
+         *  @param  block   Block to fill in
+         */
+        void write_block(CameraBlock &block) const;
+
+        /**
+         *  Generates a primary ray the same way get_ray() does in
+         *  raytracer.comp.
+         *
+         *  @param  s           Horizontal viewport coordinate in [0, 1]
+         *  @param  t           Vertical viewport coordinate in [0, 1]
+         *  @param  dx          Lens sample x on the unit disk
+         *  @param  dy          Lens sample y on the unit disk
+         *  @param  origin      Resulting ray origin
+         *  @param  direction   Resulting normalized ray direction
          */
-        void update_shader(Shader &shader);
+        void get_ray(float s, float t, float dx, float dy, vec3 &origin, vec3 &direction) const;
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,108 @@
+#ifndef _CPU_TRACER_H_
+#define _CPU_TRACER_H_
+
+#include <stdint.h>
+
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+#include "camera.h"
+#include "image.h"
+#include "scene.h"
+
+// Buckets of the path length histogram, as in raytracer.comp
+#define PATH_HISTOGRAM 64
+
+class CpuTracer {
+private:
+    const Scene* scene;
+    Camera* camera;
+    int width;
+    int height;
+    int samples;
+    int depth;
+    int rr_depth;
+    int threads;
+    int n_render;
+    uint32_t seed;
+    std::vector<float> gather;
+
+    // Paths ending after each number of bounces, the last bucket also
+    // counts longer paths
+    std::vector<uint64_t> lengths;
+    std::mutex lengths_lock;
+
+    // Image textures, row 0 is the top of each image
+    struct TextureImage {
+        std::vector<unsigned char> texels;
+        int width;
+        int height;
+    };
+    std::vector<TextureImage> images;
+
+public:
+
+    /**
+     * Creates a new CPU path tracer. It traces the same scene, camera and
+     * materials as raytracer.comp but runs on the host across every core.
+     *
+     * @param scene     Scene to render, must outlive the tracer
+     * @param width     Image width in pixels
+     * @param height    Image height in pixels
+     * @param samples   Samples per pixel per frame
+     * @param depth     Maximum path depth
+     * @param rr_depth  Bounces before Russian roulette may end a path
+     * @param threads   Number of worker threads, 0 to use every core
+     * @param seed      Random seed, -1 to seed from the current time
+     */
+    CpuTracer(const Scene &scene, int width, int height, int samples, int depth, int rr_depth, int threads, int seed = -1);
+
+    /**
+     * Destroys the CpuTracer object.
+     */
+    ~CpuTracer();
+
+    /**
+     * Loads the scene's image textures.
+     *
+     * @return  0 if success, else -1.
+     */
+    int load_textures();
+
+    /**
+     * Renders frames and accumulates them into the gather buffer, like
+     * successive dispatches of raytracer.comp.
+     *
+     * @param frames    Number of frames to render
+     */
+    void render(int frames);
+
+    /**
+     * Writes the converged average of every frame rendered so far.
+     *
+     * @param out       Image to write to
+     */
+    void resolve(Image &out) const;
+
+    /**
+     * @return  Number of frames accumulated so far.
+     */
+    int frames() const;
+
+    /**
+     * @return  Number of worker threads used per frame.
+     */
+    int thread_count() const;
+
+    /**
+     * @return  Histogram of path lengths in bounces over every frame
+     *          rendered so far, PATH_HISTOGRAM buckets.
+     */
+    const std::vector<uint64_t>& path_lengths() const;
+
+private:
+    void render_tiles(uint32_t frame_seed, std::atomic<int> &next_tile);
+};
+
+#endif
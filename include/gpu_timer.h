@@ -0,0 +1,71 @@
+#ifndef _GPU_TIMER_H_
+#define _GPU_TIMER_H_
+
+#include <stdint.h>
+
+#include <GLFW/glfw3.h>
+#include <GL/glew.h>
+
+// Frames whose timestamps can be in flight before the oldest is dropped
+#define TIMER_FRAMES 4
+
+// Most passes a frame can be split into
+#define TIMER_PASSES 8
+
+class GpuTimer {
+public:
+    GLuint m_queries[TIMER_FRAMES][TIMER_PASSES + 1];
+    int m_passes;
+    int m_pass;
+    uint64_t m_recorded;
+    uint64_t m_read;
+    uint64_t m_dropped;
+public:
+
+    /**
+     * Creates a new GpuTimer object. No queries exist until create() is
+     * called.
+     */
+    GpuTimer();
+
+    /**
+     * Destroys the GpuTimer object and its queries
+     */
+    ~GpuTimer();
+
+    /**
+     * Creates a ring of GL_TIMESTAMP queries for TIMER_FRAMES frames of the
+     * given number of passes. Needs GL 3.3 / ARB_timer_query.
+     *
+     * @param passes    Number of passes every frame is split into
+     * @return  0 if success, else -1.
+     */
+    int create(int passes);
+
+    /**
+     * Starts timing a frame with a timestamp before its first pass. A frame
+     * that was started but never finished is overwritten. When every slot
+     * of the ring still waits for its results, the oldest frame is dropped
+     * rather than waiting for the GPU.
+     *
+     * @return  Ring slot of the frame, -1 without queries.
+     */
+    int begin();
+
+    /**
+     * Ends the frame's next pass with a timestamp. The frame is finished,
+     * and can be polled, after the last pass.
+     */
+    void mark();
+
+    /**
+     * Reads the oldest finished frame whose timestamps have all arrived,
+     * without waiting for any that have not.
+     *
+     * @param ms    Receives the milliseconds of each pass
+     * @return  Ring slot of the frame that was read, -1 if none is ready.
+     */
+    int poll(double* ms);
+};
+
+#endif
@@ -0,0 +1,35 @@
+#ifndef _HEADLESS_H_
+#define _HEADLESS_H_
+
+class HeadlessContext {
+private:
+    void* m_display;
+    void* m_context;
+public:
+
+    /**
+     * Creates a new HeadlessContext object. No context exists until
+     * create() is called.
+     */
+    HeadlessContext();
+
+    /**
+     * Destroys the HeadlessContext object and its context
+     */
+    ~HeadlessContext();
+
+    /**
+     * Creates an OpenGL compatibility profile context without a display or window
+     * through EGL's surfaceless platform, which Mesa's llvmpipe provides
+     * on machines without a GPU, and makes it current. Rendering has to
+     * target textures or framebuffer objects. Only available when built
+     * with EGL (HAVE_EGL).
+     *
+     * @param major     OpenGL major version
+     * @param minor     OpenGL minor version
+     * @return  0 if success, else -1.
+     */
+    int create(int major, int minor);
+};
+
+#endif
@@ -0,0 +1,102 @@
+#ifndef _IMAGE_H_
+#define _IMAGE_H_
+
+#include <vector>
+
+#include "vector.h"
+
+class Image {
+public:
+    int width;
+    int height;
+    std::vector<float> pixels;
+public:
+
+    /**
+     * Creates a new, empty Image object.
+     */
+    Image();
+
+    /**
+     * Creates a new black Image object.
+     *
+     * @param width     Width in pixels
+     * @param height    Height in pixels
+     */
+    Image(int width, int height);
+
+    /**
+     * Gets a pixel. Row 0 is the top of the image.
+     *
+     * @param x     Column
+     * @param y     Row
+     * @return  Linear RGB color of the pixel.
+     */
+    vec3 get(int x, int y) const;
+
+    /**
+     * Sets a pixel. Row 0 is the top of the image.
+     *
+     * @param x     Column
+     * @param y     Row
+     * @param c     Linear RGB color
+     */
+    void set(int x, int y, const vec3 &c);
+
+    /**
+     * Saves the image, choosing the format from the file extension. A .pfm
+     * file keeps the linear floating point data, while .bmp, .tga and .dds
+     * are gamma corrected the same way raytracer.comp does before display.
+     *
+     * @param file      File path of the image
+     * @return  0 if success, else -1.
+     */
+    int save(const char* file) const;
+
+    /**
+     * Loads a linear .pfm image.
+     *
+     * @param file      File path of the image
+     * @return  0 if success, else -1.
+     */
+    int load(const char* file);
+
+    /**
+     * Root mean square error against a reference image of the same size,
+     * over every channel of every pixel.
+     *
+     * @param reference     Image to compare against
+     * @return  The RMSE, or -1 if the sizes differ.
+     */
+    double rmse(const Image &reference) const;
+
+    /**
+     * Relative mean square error against a reference image, every squared
+     * error divided by the squared reference value (plus 0.01) so dark and
+     * bright regions count alike.
+     *
+     * @param reference     Image to compare against
+     * @return  The relative MSE, or -1 if the sizes differ.
+     */
+    double relative_mse(const Image &reference) const;
+
+    /**
+     * Mean structural similarity (SSIM) against a reference image, computed
+     * on the gamma corrected luminance as it is displayed with 11x11
+     * gaussian windows.
+     *
+     * @param reference     Image to compare against
+     * @return  The SSIM between -1 and 1 (identical), or -2 if the sizes
+     *          differ.
+     */
+    double ssim(const Image &reference) const;
+
+    /**
+     * Mean of every channel of every pixel.
+     *
+     * @return  The mean linear value.
+     */
+    double mean() const;
+};
+
+#endif
@@ -0,0 +1,32 @@
+#ifndef _OBJ_H_
+#define _OBJ_H_
+
+#include <stdint.h>
+
+#include <vector>
+
+#include "scene.h"
+
+/**
+ * Streams a Wavefront OBJ file into indexed structure-of-arrays vertex
+ * data. Only v, vn, vt and f records are read; polygons are fan
+ * triangulated. The file is read in fixed size chunks and parsed in
+ * place, so memory use does not depend on the size of the file. New
+ * vertices and triangles are appended, with indices offset past whatever
+ * the arrays already hold.
+ *
+ * @param file          File path of the OBJ
+ * @param material      Material given to every triangle
+ * @param positions     Vertex positions, x, y, z per vertex
+ * @param normals       Vertex normals, x, y, z per vertex
+ * @param uvs           Texture coordinates, u, v per vertex
+ * @param triangles     Triangles indexing the arrays above
+ * @return  0 if success, else -1.
+ */
+int obj_load(const char* file, int32_t material,
+             std::vector<float> &positions,
+             std::vector<float> &normals,
+             std::vector<float> &uvs,
+             std::vector<Triangle> &triangles);
+
+#endif
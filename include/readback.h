@@ -0,0 +1,101 @@
+#ifndef _READBACK_H_
+#define _READBACK_H_
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <GLFW/glfw3.h>
+#include <GL/glew.h>
+
+// Downloads that can be in flight at once
+#define READBACK_SLOTS 3
+
+class Readback {
+public:
+    struct Slot {
+        GLuint buffer;
+        GLsync fence;
+        std::string file;
+    };
+
+    struct Job {
+        std::vector<float> pixels;
+        std::string file;
+    };
+
+    Slot m_slots[READBACK_SLOTS];
+    int m_width;
+    int m_height;
+    unsigned int m_next;
+    unsigned int m_pending;
+
+    // Writer thread, converts and saves the downloaded images
+    std::thread m_writer;
+    std::mutex m_lock;
+    std::condition_variable m_wake;
+    std::condition_variable m_idle;
+    std::deque<Job> m_jobs;
+    bool m_busy;
+    bool m_stop;
+    int m_failed;
+public:
+
+    /**
+     * Creates a new Readback object. No buffers exist until create() is
+     * called.
+     */
+    Readback();
+
+    /**
+     * Destroys the Readback object after the writer thread saved every
+     * image handed to it
+     */
+    ~Readback();
+
+    /**
+     * Allocates a ring of pixel pack buffers for RGBA float images of the
+     * given size and starts the writer thread.
+     *
+     * @param width     Width of the images in pixels
+     * @param height    Height of the images in pixels
+     * @return  0 if success, else -1.
+     */
+    int create(int width, int height);
+
+    /**
+     * Starts copying an accumulation texture, whose alpha holds each
+     * pixel's sample count, into the next free buffer of the ring. The
+     * copy runs on the GPU behind the work already queued and a fence
+     * marks its end, so this never waits. Shader writes to the texture
+     * must be made visible with GL_TEXTURE_UPDATE_BARRIER_BIT first.
+     *
+     * @param texture   Texture to read
+     * @param file      Image file the average of each pixel is saved to
+     * @return  0 if success, -1 if every buffer is still in use.
+     */
+    int request(GLuint texture, const char* file);
+
+    /**
+     * Hands every download the GPU has finished to the writer thread,
+     * without waiting for the others.
+     */
+    void poll();
+
+    /**
+     * Waits for every requested download and for the writer thread to save
+     * them.
+     *
+     * @return  0 if every image was saved, else -1.
+     */
+    int finish();
+
+private:
+    void collect(Slot &slot);
+    void write();
+};
+
+#endif
@@ -0,0 +1,274 @@
+#ifndef _SCENE_H_
+#define _SCENE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+#include "bvh.h"
+#include "matrix.h"
+#include "vector.h"
+
+#define MAX_IMAGES 4
+
+#define RTSCENE_MAGIC   0x43535452  // "RTSC"
+#define RTSCENE_VERSION 4
+#define RTSCENE_ALIGN   64
+
+enum MaterialType {
+    MAT_LAMBERTIAN = 0,
+    MAT_METAL = 1,
+    MAT_DIELECTRIC = 2,
+    MAT_DIFFUSE_LIGHT = 3
+};
+
+enum TextureType {
+    TEX_SOLID = 0,
+    TEX_IMAGE = 1
+};
+
+enum RectType {
+    RECT_XY = 0,
+    RECT_XZ = 1,
+    RECT_YZ = 2
+};
+
+//
+// The structs below are laid out to match their std430 counterparts in
+// raytracer.comp so the scene's arrays can be uploaded as-is.
+//
+
+struct TextureDesc {
+    vec3 color;
+    int32_t type;
+    int32_t image;
+    int32_t pad[3];
+};
+
+struct Material {
+    int32_t type;
+    int32_t albedo;
+    int32_t emit;
+    float v;
+};
+
+struct Sphere {
+    vec3 center;
+    float radius;
+    int32_t material;
+    int32_t pad[3];
+};
+
+struct Rect {
+    float a0, a1;
+    float b0, b1;
+    float k;
+    int32_t type;
+    int32_t material;
+};
+
+// Corners index the scene's position, normal and uv arrays, -1 if missing
+struct Triangle {
+    int32_t p[3];
+    int32_t n[3];
+    int32_t t[3];
+    int32_t material;
+};
+
+// Placement of an object's BVH, the rows of its world to object transform
+// and the index of the object's root node
+struct Instance {
+    float to_object[12];
+    int32_t root;
+    int32_t pad[3];
+};
+
+struct CameraDesc {
+    vec3 position;
+    vec3 lookat;
+    vec3 up;
+    float fov;
+    float aperture;
+    float focus;
+};
+
+//
+// Binary .rtscene layout: a header followed by one section per GPU buffer,
+// each stored exactly as it is uploaded and aligned to RTSCENE_ALIGN.
+//
+
+enum SceneSection {
+    SECTION_TEXTURES = 0,
+    SECTION_MATERIALS,
+    SECTION_SPHERES,
+    SECTION_RECTS,
+    SECTION_BVH_NODES,
+    SECTION_BVH_PRIMS,
+    SECTION_IMAGES,     // NUL separated image paths
+    SECTION_POSITIONS,
+    SECTION_NORMALS,
+    SECTION_UVS,
+    SECTION_TRIANGLES,
+    SECTION_INSTANCES,
+    SECTION_LIGHTS,
+    SECTION_COUNT
+};
+
+struct SceneFileHeader {
+    uint32_t magic;
+    uint32_t version;
+    CameraDesc camera;
+    struct {
+        uint64_t offset;
+        uint64_t size;
+    } sections[SECTION_COUNT];
+};
+
+/**
+ * Read-only view of a contiguous array, either owned by a Scene or living
+ * inside a mapped .rtscene file.
+ */
+template <typename T>
+struct ArrayView {
+    const T* data;
+    size_t count;
+
+    ArrayView() : data(NULL), count(0) {}
+    ArrayView(const T* d, size_t n) : data(d), count(n) {}
+    ArrayView(const std::vector<T> &v) : data(v.data()), count(v.size()) {}
+
+    const T& operator[](size_t i) const { return data[i]; }
+    const T* begin() const { return data; }
+    const T* end() const { return data + count; }
+    size_t size() const { return count; }
+    size_t bytes() const { return count * sizeof(T); }
+    bool empty() const { return count == 0; }
+};
+
+class Scene {
+public:
+    ArrayView<TextureDesc> textures;
+    ArrayView<Material> materials;
+    ArrayView<Sphere> spheres;
+    ArrayView<Rect> rects;
+    ArrayView<float> positions;     // x, y, z per vertex
+    ArrayView<float> normals;       // x, y, z per vertex
+    ArrayView<float> uvs;           // u, v per vertex
+    ArrayView<Triangle> triangles;
+    ArrayView<Instance> instances;
+    ArrayView<int32_t> lights;      // Emissive rects, sampled directly
+    ArrayView<BVHNode> nodes;       // Top level BVH at 0, then one per object
+    ArrayView<int32_t> prims;
+    std::vector<std::string> images;
+    CameraDesc camera;
+
+private:
+    // Storage for scenes parsed from text
+    std::vector<TextureDesc> m_textures;
+    std::vector<Material> m_materials;
+    std::vector<Sphere> m_spheres;
+    std::vector<Rect> m_rects;
+    std::vector<float> m_positions;
+    std::vector<float> m_normals;
+    std::vector<float> m_uvs;
+    std::vector<Triangle> m_triangles;
+    std::vector<Instance> m_instances;
+    std::vector<int32_t> m_lights;
+    std::vector<BVHNode> m_nodes;
+    std::vector<int32_t> m_prims;
+
+    // Objects are primitive groups with their own BVH, placed by instances
+    struct Object {
+        std::vector<int32_t> refs;
+    };
+    struct Placement {
+        int32_t object;
+        mat4 to_world;
+    };
+    std::vector<Object> m_objects;
+    std::vector<Placement> m_placements;
+
+    // Mapping of a binary scene
+    void* m_map;
+    size_t m_map_size;
+
+public:
+
+    /**
+     * Creates an empty Scene. Texture 0 is always solid black so materials
+     * have something to point at for unused slots.
+     */
+    Scene();
+
+    /**
+     * Unmaps the scene file, if any.
+     */
+    ~Scene();
+
+    Scene(const Scene &) = delete;
+    Scene& operator=(const Scene &) = delete;
+
+    /**
+     * Loads a scene, either a binary .rtscene file or a text description.
+     * Each line of a text description holds one directive, '#' starts a
+     * comment:
+     *
+     *  camera  px py pz  lx ly lz  ux uy uz  fov aperture focus
+     *  texture <name> solid r g b
+     *  texture <name> image <file>
+     *  material <name> lambertian <texture>
+     *  material <name> metal <texture> <fuzz>
+     *  material <name> dielectric <ior>
+     *  material <name> light <texture>
+     *  sphere  cx cy cz radius <material>
+     *  rect    xy|xz|yz a0 a1 b0 b1 k <material>
+     *  mesh    <file.obj> <material>
+     *  object  <name> <file.obj> <material>
+     *  instance <object> tx ty tz  rx ry rz  scale
+     *
+     * Spheres and rects form one object and every mesh another, each placed
+     * once as is. Named objects are only rendered where they are instanced:
+     * scaled, rotated about x, y then z by degrees and translated. Names
+     * must be declared before they are used. After parsing a BVH is built
+     * per object, in object space, and a top level BVH over the instances.
+     *
+     * @param file      File path of the scene
+     * @return  0 if success, else -1.
+     */
+    int load(const char* file);
+
+    /**
+     * Maps a binary .rtscene file. Every array of the scene points straight
+     * into the mapping, nothing is parsed or copied.
+     *
+     * @param file      File path of the scene
+     * @return  0 if success, else -1.
+     */
+    int load_binary(const char* file);
+
+    /**
+     * Writes the scene, including its BVH, as a binary .rtscene file.
+     *
+     * @param file      File path of the scene
+     * @return  0 if success, else -1.
+     */
+    int save_binary(const char* file) const;
+
+    /**
+     * Computes the bounding box of a primitive.
+     *
+     * @param ref       Packed primitive reference
+     * @return  Bounds of the primitive.
+     */
+    AABB bounds(int32_t ref) const;
+
+private:
+    int load_text(const char* file);
+    int validate(const char* file) const;
+    void build_bvh();
+    void unmap();
+};
+
+#endif
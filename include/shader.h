@@ -2,6 +2,9 @@
 #define _SHADER_H_
 
 #include <stdlib.h>
+#include <string>
+#include <unordered_map>
+#include <vector>
 
 #include "matrix.h"
 #include "texture.h"
@@ -17,8 +20,18 @@ enum ShaderType {
 class Shader {
 public:
     GLuint program;
+
+    // Whether compile() loaded the program from the binary cache
+    bool cached;
 private:
-    GLuint shaders[4];
+    std::string sources[4];
+    std::vector<std::string> files[4];
+
+    // #define lines pasted into every stage by compile()
+    std::string defines;
+
+    // Locations of the active uniforms, looked up once after linking
+    std::unordered_map<std::string, GLint> locations;
 public:
 
     /**
@@ -32,7 +45,16 @@ public:
     ~Shader();
 
     /**
-     * Loads and attaches a shader from text.
+     * Sets the directory compiled programs are cached in, keyed by a hash
+     * of their sources and the driver. Programs whose sources are unchanged
+     * are loaded from there by compile() instead of being compiled again.
+     *
+     * @param dir   Cache directory, NULL to always compile
+     */
+    static void set_cache_dir(const char* dir);
+
+    /**
+     * Loads and attaches a shader from text, it is compiled by compile().
      *
      * @param type      Type of shader to attach.
      * @param src       The text of the shader.
@@ -41,7 +63,9 @@ public:
     int load_text(enum ShaderType type, const char* src);
 
     /**
-     * Loads and attaches a shader from a file.
+     * Loads and attaches a shader from a file. Lines of the form
+     * #include "file" are replaced by that file, found relative to the
+     * including one.
      *
      * @param type      Type of shader to attach.
      * @param file      File path of the file to open and read.
@@ -50,7 +74,20 @@ public:
     int load_file(enum ShaderType type, const char* file);
 
     /**
-     * Attempts to compiles all attached shaders. To prevent memory
+     * Defines a preprocessor macro for every stage, inserted right after
+     * their #version line when compile() builds the program. Each set of
+     * defines is a variant of its own in the program cache.
+     *
+     * @param name      Name of the macro
+     * @param value     Text the macro expands to
+     */
+    void define(const char* name, const char* value = "1");
+    void define(const char* name, int value);
+
+    /**
+     * Attempts to compiles all attached shaders, or loads the program from
+     * the cache if it was compiled before. Cached programs the driver does
+     * not accept anymore are compiled and cached again. To prevent memory
      * leakages, make sure to call dispose() when you're done using the
      * shader.
      *
@@ -58,6 +95,15 @@ public:
      */
     int compile();
 
+    /**
+     * Gets the location of an active uniform without asking the driver.
+     *
+     * @param name      Name of the uniform, array elements as name[i]
+     * @return  The uniform's location, -1 if the program has no such
+     *          uniform (setting it then does nothing).
+     */
+    GLint location(const char* name) const;
+
     /**
      * Updates a shader's uniform.
      *
@@ -71,7 +117,8 @@ public:
     void uniform_int(const char* name, int data);
 
     /**
-     * Binds a uniform buffer object to a Shader by slot number.
+     * Binds a uniform buffer object to a Shader by slot number. Programs
+     * without the block are left alone.
      *
      * @param name      Name of uniform buffer
      * @param slot      Slot where the uniform buffer is bound.
@@ -87,6 +134,9 @@ public:
      * Unbinds shaders
      */
     void unbind();
+
+private:
+    void find_locations();
 };
 
 #endif
\ No newline at end of file
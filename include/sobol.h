@@ -0,0 +1,22 @@
+#ifndef _SOBOL_H_
+#define _SOBOL_H_
+
+#include <stdint.h>
+
+// Dimensions of the Sobol sequence supplied to the shaders, each sample call
+// in raytracer.comp draws at most this many from one Owen-scrambled point
+#define SOBOL_DIMENSIONS 4
+
+// One direction number per bit of the 32 bit sample index
+#define SOBOL_BITS 32
+
+/**
+ * Computes the Sobol direction numbers, using the Joe-Kuo primitive
+ * polynomials and initial values. Dimension d's numbers are stored at
+ * directions[d * SOBOL_BITS], bit i's number in the top i + 1 bits.
+ *
+ * @param directions    Destination, SOBOL_DIMENSIONS * SOBOL_BITS entries.
+ */
+void sobol_directions(uint32_t* directions);
+
+#endif
@@ -62,11 +62,11 @@ struct vec3 {
         return (1/t) * v;
     }
 
-    float dot(const vec3 &v) {
+    float dot(const vec3 &v) const {
         return e[0] * v.e[0] + e[1] * v.e[1] + e[2] * v.e[2];
     }
 
-    vec3 cross(const vec3 &v) {
+    vec3 cross(const vec3 &v) const {
         return vec3(
             e[1] * v.e[2] - e[2] * v.e[1],
             e[2] * v.e[0] - e[0] * v.e[2],
@@ -74,7 +74,7 @@ struct vec3 {
         );
     }
 
-    float length() {
+    float length() const {
         return sqrt(e[0]*e[0] + e[1]*e[1] + e[2]*e[2]);
     }
 
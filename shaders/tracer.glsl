@@ -0,0 +1,1066 @@
+#define PI 3.14159265f
+
+#define MAT_LAMBERTIAN 0
+#define MAT_METAL 1
+#define MAT_DIELECTRIC 2
+#define MAT_DIFFUSE_LIGHT 3
+#define MATERIAL_TYPES 4
+
+#define TEX_SOLID 0
+#define TEX_IMAGE 1
+
+#define RECT_XY 0
+#define RECT_XZ 1
+#define RECT_YZ 2
+
+#define MAX_IMAGES  4
+
+#define PRIM_SPHERE   0
+#define PRIM_RECT     1
+#define PRIM_TRIANGLE 2
+
+// Same as BVH_MAX_DEPTH in bvh.h, Scene::load rejects deeper trees
+#define BVH_STACK_SIZE 64
+
+// Buckets of the path length histogram, the last one also counts longer paths
+#define PATH_HISTOGRAM 64
+
+// Specializations the host may define before compiling (see specialize() in
+// main.cpp), the kernels handle any scene, depth and size without them:
+//   MAX_DEPTH                   path depth, in place of the depth uniform
+//   MATERIAL_MASK               a bit per MAT_* type the scene uses
+//   PRIMITIVE_MASK              a bit per PRIM_* type the scene uses
+//   TEXTURE_MASK                a bit per TEX_* type the scene uses
+//   IMAGE_WIDTH, IMAGE_HEIGHT   resolution, in place of width and height
+#ifndef MATERIAL_MASK
+#define MATERIAL_MASK 0xF
+#endif
+#ifndef PRIMITIVE_MASK
+#define PRIMITIVE_MASK 0x7
+#endif
+#ifndef TEXTURE_MASK
+#define TEXTURE_MASK 0x3
+#endif
+
+#ifdef MAX_DEPTH
+#define TRACE_DEPTH MAX_DEPTH
+#else
+#define TRACE_DEPTH depth
+#endif
+
+#if defined(IMAGE_WIDTH) && defined(IMAGE_HEIGHT)
+#define TRACE_WIDTH float(IMAGE_WIDTH)
+#define TRACE_HEIGHT float(IMAGE_HEIGHT)
+#else
+#define TRACE_WIDTH width
+#define TRACE_HEIGHT height
+#endif
+
+//
+//  Sampling
+//
+
+#define SOBOL_DIMENSIONS 4
+#define SOBOL_BITS 32
+
+// Sobol direction numbers from sobol_directions(), dimension d at d * 32,
+// packed four to an element against std140's array stride. A uniform block
+// keeps the storage blocks free for the scene, compute shaders only
+// promise 16 of those.
+layout(std140, binding = 0) uniform sobol_table {
+    uvec4 sobol_directions[SOBOL_DIMENSIONS * SOBOL_BITS / 4];
+};
+
+// Sampler state. Every pixel walks its own Owen-scrambled Sobol sequence,
+// g_index is the sample being taken and g_dim counts the sample calls made
+// along its path, each of which is scrambled independently.
+uint g_pixel = 0u;
+uint g_index = 0u;
+uint g_dim = 0u;
+
+uint hash(uint x) {
+    x ^= x >> 16;
+    x *= 0x7feb352dU;
+    x ^= x >> 15;
+    x *= 0x846ca68bU;
+    x ^= x >> 16;
+    return x;
+}
+
+uint hash_combine(uint seed, uint v) {
+    return seed ^ (v + 0x9e3779b9U + (seed << 6) + (seed >> 2));
+}
+
+// Laine-Karras style permutation, bits only ever depend on lower bits
+uint laine_karras(uint x, uint seed) {
+    x += seed;
+    x ^= x * 0x6c50b47cU;
+    x ^= x * 0xb82f1e52U;
+    x ^= x * 0xc7afe638U;
+    x ^= x * 0x8d22f6e6U;
+    return x;
+}
+
+// Owen scrambling of a 32 bit fixed point value in [0, 1)
+uint owen_scramble(uint x, uint seed) {
+    return bitfieldReverse(laine_karras(bitfieldReverse(x), seed));
+}
+
+uint sobol(uint index, uint dim) {
+    uint x = 0u;
+    for (; index != 0u; index &= index - 1u) {
+        uint i = dim * SOBOL_BITS + uint(findLSB(index));
+        x ^= sobol_directions[i >> 2][i & 3u];
+    }
+    return x;
+}
+
+void sampler_start(uint pixel, uint index, uint seed) {
+    g_pixel = hash_combine(hash(pixel), seed);
+    g_index = index;
+    g_dim = 0u;
+}
+
+// Picks a path's samples back up where an earlier kernel left off
+void sampler_resume(uint pixel, uint index, uint seed, uint dim) {
+    sampler_start(pixel, index, seed);
+    g_dim = dim;
+}
+
+float to_unit(uint x) {
+    return float(x >> 8) * (1.0f / 16777216.0f);
+}
+
+// Next sample call's scrambled Sobol point, shuffling the sample order per
+// call decorrelates the dimensions that come from the same table
+uint sample_point(out uint seed) {
+    seed = hash(hash_combine(g_pixel, g_dim++));
+    return owen_scramble(g_index, seed);
+}
+
+float sample1f() {
+    uint seed;
+    uint i = sample_point(seed);
+    return to_unit(owen_scramble(sobol(i, 0u), hash_combine(seed, 0u)));
+}
+
+vec2 sample2f() {
+    uint seed;
+    uint i = sample_point(seed);
+    return vec2(
+        to_unit(owen_scramble(sobol(i, 0u), hash_combine(seed, 0u))),
+        to_unit(owen_scramble(sobol(i, 1u), hash_combine(seed, 1u)))
+    );
+}
+
+vec3 sample3f() {
+    uint seed;
+    uint i = sample_point(seed);
+    return vec3(
+        to_unit(owen_scramble(sobol(i, 0u), hash_combine(seed, 0u))),
+        to_unit(owen_scramble(sobol(i, 1u), hash_combine(seed, 1u))),
+        to_unit(owen_scramble(sobol(i, 2u), hash_combine(seed, 2u)))
+    );
+}
+
+vec3 unit_sphere() {
+    vec3 h = sample3f() * vec3(2.,6.28318530718,1.)-vec3(1,0,0);
+    float phi = h.y;
+    float r = pow(h.z, 1./3.);
+	return r * vec3(sqrt(1.-h.x*h.x)*vec2(sin(phi),cos(phi)),h.x);
+}
+
+vec2 unit_disk() {
+    vec2 h = sample2f() * vec2(1.0, 6.28318530718);
+    float phi = h.y;
+    float r = sqrt(h.x);
+	return r * vec2(sin(phi),cos(phi));
+}
+
+vec3 unit_hemisphere(const vec3 n) {
+    vec2 r = sample2f();
+	vec3  uu = normalize(cross(n, abs(n.y) > 0.5f ? vec3(1.0, 0.0, 0.0) : vec3(0.0, 1.0, 0.0)));
+	vec3  vv = cross(uu, n);
+	float ra = sqrt(r.y);
+	float rx = ra*cos(6.28318530718*r.x); 
+	float ry = ra*sin(6.28318530718*r.x);
+	float rz = sqrt(1.-r.y);
+	vec3  rr = vec3(rx*uu + ry*vv + rz*n);
+    return normalize(rr);
+}
+
+//
+//  CAMERA
+//
+
+struct camera {
+    vec3 lower_left;
+    vec3 right;
+    vec3 up;
+    vec3 origin;
+    vec3 u;
+    vec3 v;
+    float lens;
+};
+
+// Written by the host whenever they change, see FrameParams in main.cpp
+layout(std140) uniform frame_params {
+    camera cam;
+    int i_seed;
+    int samples;
+    int depth;
+    int rr_depth;
+    float width;
+    float height;
+};
+
+
+//
+// RAY
+//
+
+struct ray {
+    vec3 origin;
+    vec3 direction;
+};
+
+ray get_ray(vec2 s) {
+    vec2 rd = cam.lens * unit_disk();
+    vec3 off = (rd.x * cam.u) + (rd.y * cam.v);
+
+    ray r = ray(
+        cam.origin + off,
+        normalize(cam.lower_left + (s.x * cam.right) + (s.y * cam.up) - cam.origin - off)
+    );
+    return r;
+}
+
+//
+// SCENE
+//
+
+struct texture_ {
+    vec3 color;
+    int type;
+    int image;
+};
+
+struct material {
+    int type;
+    int albedo;
+    int emit;
+    float v;
+};
+
+struct sphere {
+    vec3 center;
+    float radius;
+    int mat;
+};
+
+struct rectangle {
+    float a0, a1;
+    float b0, b1;
+    float k;
+    int type;
+    int mat;
+};
+
+layout(std430, binding = 2) readonly buffer scene_textures {
+    texture_ textures[];
+};
+
+layout(std430, binding = 3) readonly buffer scene_materials {
+    material materials[];
+};
+
+layout(std430, binding = 4) readonly buffer scene_spheres {
+    sphere spheres[];
+};
+
+layout(std430, binding = 5) readonly buffer scene_rects {
+    rectangle rects[];
+};
+
+// Corners index the vertex arrays below, -1 if missing
+struct triangle {
+    int p[3];
+    int n[3];
+    int t[3];
+    int mat;
+};
+
+layout(std430, binding = 6) readonly buffer scene_positions {
+    float positions[];
+};
+
+layout(std430, binding = 7) readonly buffer scene_normals {
+    float normals[];
+};
+
+layout(std430, binding = 8) readonly buffer scene_uvs {
+    float uvs[];
+};
+
+layout(std430, binding = 9) readonly buffer scene_triangles {
+    triangle triangles[];
+};
+
+layout (binding = 2) uniform sampler2D images[MAX_IMAGES];
+
+vec3 texture_color(const in int t, const in vec2 uv) {
+#if TEXTURE_MASK & (1 << TEX_IMAGE)
+    if (textures[t].type == TEX_IMAGE) {
+        // Sampler arrays may only be indexed with constant expressions
+        switch (textures[t].image) {
+            case 0: return vec3(texture(images[0], uv));
+            case 1: return vec3(texture(images[1], uv));
+            case 2: return vec3(texture(images[2], uv));
+            case 3: return vec3(texture(images[3], uv));
+        }
+    }
+#endif
+    return textures[t].color;
+}
+
+struct hit {
+    float t;
+    vec3 point;
+    vec3 normal;
+    vec2 uv;
+    bool front;
+    int mat;
+    int prim;
+};
+
+// AABB
+struct aabb {
+    vec3 a;
+    vec3 b;
+};
+
+// Slab test against a box. inv is 1 / r.direction, precomputed once per ray.
+// On a hit t_enter is where the ray enters the box.
+bool aabb_hit(const aabb box, const ray r, const vec3 inv, float t_min, float t_max, out float t_enter) {
+    vec3 t0 = (box.a - r.origin) * inv;
+    vec3 t1 = (box.b - r.origin) * inv;
+    vec3 lo = min(t0, t1);
+    vec3 hi = max(t0, t1);
+
+    t_min = max(t_min, max(lo.x, max(lo.y, lo.z)));
+    t_max = min(t_max, min(hi.x, min(hi.y, hi.z)));
+    t_enter = t_min;
+    return t_min <= t_max;
+}
+
+//
+// BVH
+//
+
+struct bvh_node {
+    vec3 a;
+    int next;
+    vec3 b;
+    int count;
+};
+
+layout(std430, binding = 0) readonly buffer bvh_nodes {
+    bvh_node nodes[];
+};
+
+layout(std430, binding = 1) readonly buffer bvh_prims {
+    int prims[];
+};
+
+// Placement of an object's BVH, rows of the world to object transform
+struct instance {
+    vec4 to_object[3];
+    int root;
+};
+
+layout(std430, binding = 10) readonly buffer scene_instances {
+    instance instances[];
+};
+
+// Emissive rects, indices into rects
+layout(std430, binding = 11) readonly buffer scene_lights {
+    int lights[];
+};
+
+bool node_hit(const int i, const ray r, const vec3 inv, float t_min, float t_max, out float t_enter) {
+    return aabb_hit(aabb(nodes[i].a, nodes[i].b), r, inv, t_min, t_max, t_enter);
+}
+
+//
+// SPHERES
+//
+
+// The direction need not be normalized, rays inside instances are scaled
+bool intersect_sphere(const sphere s, const ray r, float t_min, float t_max, inout float dist) {
+    vec3 oc = r.origin - s.center;
+    float a = dot(r.direction, r.direction);
+    float b = dot(oc, r.direction);
+    float c = dot(oc, oc) - (s.radius * s.radius);
+    float d = b * b - a * c;
+    if (d < 0.0f) return false;
+
+    float sq = sqrt(d);
+    float t1 = (-b - sq) / a;
+    float t2 = (-b + sq) / a;
+
+    float t = t1 < t_min ? t2 : t1;
+    if (t < t_max && t > t_min) {
+        dist = t;
+        return true;
+    }
+    return false;
+}
+
+bool hit_sphere(const in sphere s, const in ray r, const in float t_min, const in float t_max, inout hit h) {
+    float dist;
+    if (intersect_sphere(s, r, t_min, t_max, dist)) {
+        h.t = dist;
+        h.point = r.origin + dist * r.direction;
+        h.normal = (h.point - s.center) / s.radius;
+        h.mat = s.mat;
+
+        float phi = atan(h.normal.z, h.normal.x);
+        float theta = asin(h.normal.y);
+        h.uv = vec2(1 - (phi + PI) / (2 * PI), (theta + (PI / 2)) / PI);
+        return true;
+    }
+    return false;
+}
+
+// 
+// RECTANGLES
+//
+
+bool dispatch_hit_rect(const in rectangle rect, const in ray r, const in float t_min, const in float t_max, inout hit h) {
+    float t, a, b;
+    vec3 n, p;
+    if (rect.type == RECT_XY) {
+        t = (rect.k - r.origin.z) / r.direction.z;
+        p = r.origin + t * r.direction;
+        a = p.x;
+        b = p.y;
+        n = vec3(0, 0, 1);
+    } else if (rect.type == RECT_XZ) {
+        t = (rect.k - r.origin.y) / r.direction.y;
+        p = r.origin + t * r.direction;
+        a = p.x;
+        b = p.z;
+        n = vec3(0, 1, 0);
+    } else if  (rect.type == RECT_YZ) {
+        t = (rect.k - r.origin.x) / r.direction.x;
+        p = r.origin + t * r.direction;
+        a = p.y;
+        b = p.z;
+        n = vec3(1, 0, 0); 
+    }
+
+    if (t < t_min || t > t_max) {
+        return false;
+    }
+    if (a < rect.a0 || a > rect.a1 || b < rect.b0 || b > rect.b1) {
+        return false;
+    }
+    bool face = dot(r.direction, n) < 0;
+    h.t = t;
+    h.point = p;
+    h.normal = face ? n : -n;
+    h.uv = vec2((a - rect.a0) / (rect.a1 - rect.a0), (b - rect.b0) / (rect.b1 - rect.b0));
+    h.mat = rect.mat;
+    return true;
+}
+
+//
+// TRIANGLES
+//
+
+// Per-ray constants of the watertight ray/triangle test (Woop et al. 2013)
+struct watertight {
+    int kx, ky, kz;
+    vec3 s;
+};
+
+watertight watertight_setup(const ray r) {
+    vec3 d = abs(r.direction);
+    int kz = d.x > d.y ? (d.x > d.z ? 0 : 2) : (d.y > d.z ? 1 : 2);
+    int kx = kz == 2 ? 0 : kz + 1;
+    int ky = kx == 2 ? 0 : kx + 1;
+    if (r.direction[kz] < 0.0f) {
+        int tmp = kx;
+        kx = ky;
+        ky = tmp;
+    }
+
+    watertight w;
+    w.kx = kx;
+    w.ky = ky;
+    w.kz = kz;
+    w.s = vec3(r.direction[kx] / r.direction[kz], r.direction[ky] / r.direction[kz], 1.0f / r.direction[kz]);
+    return w;
+}
+
+vec3 vertex_position(const int i) {
+    return vec3(positions[3 * i], positions[3 * i + 1], positions[3 * i + 2]);
+}
+
+vec3 vertex_normal(const int i) {
+    return vec3(normals[3 * i], normals[3 * i + 1], normals[3 * i + 2]);
+}
+
+vec2 vertex_uv(const int i) {
+    return vec2(uvs[2 * i], uvs[2 * i + 1]);
+}
+
+bool hit_triangle(const in int index, const in ray r, const in watertight w, const in float t_min, const in float t_max, inout hit h) {
+    triangle tri = triangles[index];
+    vec3 p0 = vertex_position(tri.p[0]);
+    vec3 p1 = vertex_position(tri.p[1]);
+    vec3 p2 = vertex_position(tri.p[2]);
+
+    // Shear and scale the vertices into ray space
+    vec3 a = p0 - r.origin;
+    vec3 b = p1 - r.origin;
+    vec3 c = p2 - r.origin;
+    float ax = a[w.kx] - w.s.x * a[w.kz];
+    float ay = a[w.ky] - w.s.y * a[w.kz];
+    float bx = b[w.kx] - w.s.x * b[w.kz];
+    float by = b[w.ky] - w.s.y * b[w.kz];
+    float cx = c[w.kx] - w.s.x * c[w.kz];
+    float cy = c[w.ky] - w.s.y * c[w.kz];
+
+    // Scaled barycentrics, an edge hit counts for exactly one triangle
+    float u = cx * by - cy * bx;
+    float v = ax * cy - ay * cx;
+    float e = bx * ay - by * ax;
+
+    // Edges through the ray are resolved in double precision
+    if (u == 0.0f || v == 0.0f || e == 0.0f) {
+        u = float(double(cx) * double(by) - double(cy) * double(bx));
+        v = float(double(ax) * double(cy) - double(ay) * double(cx));
+        e = float(double(bx) * double(ay) - double(by) * double(ax));
+    }
+    if ((u < 0.0f || v < 0.0f || e < 0.0f) && (u > 0.0f || v > 0.0f || e > 0.0f)) {
+        return false;
+    }
+    float det = u + v + e;
+    if (det == 0.0f) {
+        return false;
+    }
+
+    float t = (u * a[w.kz] + v * b[w.kz] + e * c[w.kz]) * w.s.z / det;
+    if (t <= t_min || t >= t_max) {
+        return false;
+    }
+
+    vec3 bary = vec3(u, v, e) / det;
+    h.t = t;
+    h.point = r.origin + t * r.direction;
+    h.normal = tri.n[0] >= 0
+        ? normalize(bary.x * vertex_normal(tri.n[0]) + bary.y * vertex_normal(tri.n[1]) + bary.z * vertex_normal(tri.n[2]))
+        : normalize(cross(p1 - p0, p2 - p0));
+    h.uv = tri.t[0] >= 0
+        ? bary.x * vertex_uv(tri.t[0]) + bary.y * vertex_uv(tri.t[1]) + bary.z * vertex_uv(tri.t[2])
+        : bary.yz;
+    h.mat = tri.mat;
+    return true;
+}
+
+float schlick(float c, float r) {
+    float r0 = (1 - r) / (1 + r);
+    r0 = r0 * r0;
+    return r0 + (1 - r0) * pow(1 - c, 5);
+}
+
+bool mrefract(const in vec3 v, const in vec3 n, const in float s, out vec3 ref) {
+    float dt = dot(v, n);
+    float d = 1. - s*s*(1.-dt*dt);
+    if (d > 0.0f) {
+        ref = s * (v - n * dt) - n * sqrt(d);
+        return true;
+    } else { 
+        return false;
+    }
+}
+
+// Density of normalize(ref + fuzz * u) for u uniform in the unit ball: the
+// t^2 weighted length of the ray t * wi inside the fuzz ball over its volume
+float metal_pdf(const vec3 ref, const float fuzz, const vec3 wi) {
+    float b = dot(wi, ref);
+    float d = b * b - (1.0f - fuzz * fuzz);
+    if (d <= 0.0f) {
+        return 0.0f;
+    }
+    float sq = sqrt(d);
+    float t0 = max(b - sq, 0.0f);
+    float t1 = max(b + sq, 0.0f);
+    return (t1 * t1 * t1 - t0 * t0 * t0) / (4.0f * PI * fuzz * fuzz * fuzz);
+}
+
+// The scatter functions report the solid angle pdf of the direction they
+// picked, 0 if it came from a delta distribution. Lambertian and metal are
+// sampled in proportion to BSDF times cosine, so attn * pdf is that product
+// for any direction.
+
+bool scatter_lambertian(const ray r, const hit rec, out vec3 attn, out ray scatter, out float pdf) {
+    // Meshes keep their outward normal, so face it towards the ray
+    vec3 n = dot(r.direction, rec.normal) > 0.0f ? -rec.normal : rec.normal;
+    scatter = ray(
+        rec.point,
+        unit_hemisphere(n)
+    );
+    attn = texture_color(materials[rec.mat].albedo, rec.uv);
+    pdf = max(dot(n, scatter.direction), 0.0f) / PI;
+    return true;
+}
+
+bool scatter_metal(const ray r, const hit rec, out vec3 attn, out ray scatter, out float pdf) {
+    vec3 ref = reflect(normalize(r.direction), rec.normal);
+    float fuzz = materials[rec.mat].v;
+    scatter = ray(
+        rec.point,
+        normalize(ref + (fuzz * unit_sphere()))
+    );
+    attn = texture_color(materials[rec.mat].albedo, rec.uv);
+    pdf = fuzz > 0.0f ? metal_pdf(ref, fuzz, scatter.direction) : 0.0f;
+    return true;
+}
+
+bool scatter_dieletric(const ray r, const hit rec, out vec3 attn, out ray scatter, out float pdf) {
+    vec3 refl = reflect(normalize(r.direction), rec.normal);
+    float ct = dot(normalize(r.direction), rec.normal);
+    
+    attn = vec3(1.0f, 1.0f, 1.0f);
+    pdf = 0.0f;
+    vec3 outward = ct > 0.0f ? -rec.normal : rec.normal;
+    float s = ct > 0.0f ? materials[rec.mat].v : 1.0f / materials[rec.mat].v;
+    ct = ct > 0.0f ? sqrt(1.0f - materials[rec.mat].v * materials[rec.mat].v * (1.0f - ct * ct)) : -ct;
+
+    vec3 refr;
+    float refp;
+    if (mrefract(normalize(r.direction), outward, s, refr)) {
+        refp = schlick(ct, materials[rec.mat].v);
+    } else {
+        refp = 1.0f;
+    }
+
+    if (sample1f() < refp) {
+        scatter = ray(
+            rec.point,
+            refl
+        );
+    } else {
+        scatter = ray(
+            rec.point,
+            refr
+        );
+    }
+    return true;
+}
+
+// Materials missing from MATERIAL_MASK are compiled out
+bool dispatch_scatter(const ray r, hit rec, out vec3 attn, out ray scatter, out float pdf) {
+#if MATERIAL_MASK & (1 << MAT_METAL)
+    if (materials[rec.mat].type == MAT_METAL) {
+        return scatter_metal(r, rec, attn, scatter, pdf);
+    }
+#endif
+#if MATERIAL_MASK & (1 << MAT_DIELECTRIC)
+    if (materials[rec.mat].type == MAT_DIELECTRIC) {
+        return scatter_dieletric(r, rec, attn, scatter, pdf);
+    }
+#endif
+#if MATERIAL_MASK & (1 << MAT_LAMBERTIAN)
+    if (materials[rec.mat].type == MAT_LAMBERTIAN){
+        return scatter_lambertian(r, rec, attn, scatter, pdf);
+    }
+#endif
+    return false;
+}
+
+// Solid angle pdf of scattering towards wi, for the non-delta materials
+float dispatch_pdf(const ray r, const hit rec, const vec3 wi) {
+#if MATERIAL_MASK & (1 << MAT_METAL)
+    if (materials[rec.mat].type == MAT_METAL) {
+        vec3 ref = reflect(normalize(r.direction), rec.normal);
+        return metal_pdf(ref, materials[rec.mat].v, wi);
+    }
+#endif
+    vec3 n = dot(r.direction, rec.normal) > 0.0f ? -rec.normal : rec.normal;
+    return max(dot(n, wi), 0.0f) / PI;
+}
+
+vec3 dispatch_emit(const in hit h) {
+#if MATERIAL_MASK & (1 << MAT_DIFFUSE_LIGHT)
+    if (materials[h.mat].type == MAT_DIFFUSE_LIGHT) {
+        return texture_color(materials[h.mat].emit, h.uv);
+    }
+#endif
+    return vec3(0.0f);
+}
+
+// Hit of one primitive of a BVH leaf, kinds missing from PRIMITIVE_MASK are
+// compiled out
+bool dispatch_hit(const int kind, const int index, const ray r, const watertight w, float t_min, float closest, inout hit h) {
+#if PRIMITIVE_MASK & (1 << PRIM_SPHERE)
+    if (kind == PRIM_SPHERE) {
+        return hit_sphere(spheres[index], r, t_min, closest, h);
+    }
+#endif
+#if PRIMITIVE_MASK & (1 << PRIM_RECT)
+    if (kind == PRIM_RECT) {
+        return dispatch_hit_rect(rects[index], r, t_min, closest, h);
+    }
+#endif
+#if PRIMITIVE_MASK & (1 << PRIM_TRIANGLE)
+    return hit_triangle(index, r, w, t_min, closest, h);
+#else
+    return false;
+#endif
+}
+
+// Closest hit in one object's BVH, r is in the object's space
+bool object_hit(const int root, const ray r, float t_min, inout float closest, inout hit rec) {
+    hit temp;
+    bool found = false;
+
+    vec3 inv = 1.0f / r.direction;
+    watertight w = watertight_setup(r);
+    float t_near, t_far;
+    if (!node_hit(root, r, inv, t_min, closest, t_near)) {
+        return false;
+    }
+
+    int stack[BVH_STACK_SIZE];
+    int sp = 0;
+    int node = root;
+    while (true) {
+        if (nodes[node].count > 0) {
+            // Leaf, test every primitive
+            int first = nodes[node].next;
+            for (int i = first; i < first + nodes[node].count; i++) {
+                int ref = prims[i];
+                int index = ref >> 2;
+                int kind = ref & 3;
+                if (dispatch_hit(kind, index, r, w, t_min, closest, temp)) {
+                    found = true;
+                    rec = temp;
+                    rec.prim = ref;
+                    closest = temp.t;
+                }
+            }
+            if (sp == 0) break;
+            node = stack[--sp];
+        } else {
+            // Interior, visit the nearer child first
+            int left = node + 1;
+            int right = nodes[node].next;
+            bool hl = node_hit(left, r, inv, t_min, closest, t_near);
+            bool hr = node_hit(right, r, inv, t_min, closest, t_far);
+            if (hl && hr) {
+                node = t_near <= t_far ? left : right;
+                stack[sp++] = t_near <= t_far ? right : left;
+            } else if (hl || hr) {
+                node = hl ? left : right;
+            } else {
+                if (sp == 0) break;
+                node = stack[--sp];
+            }
+        }
+    }
+
+    return found;
+}
+
+// Closest hit among the instances, whose leaves hold instance indices
+bool world(const ray r, float t_min, float t_max, out hit rec) {
+    bool found = false;
+    float closest = t_max;
+
+    vec3 inv = 1.0f / r.direction;
+    float t_near, t_far;
+    if (!node_hit(0, r, inv, t_min, closest, t_near)) {
+        return false;
+    }
+
+    int stack[BVH_STACK_SIZE];
+    int sp = 0;
+    int node = 0;
+    while (true) {
+        if (nodes[node].count > 0) {
+            int first = nodes[node].next;
+            for (int i = first; i < first + nodes[node].count; i++) {
+                instance inst = instances[prims[i]];
+
+                // The direction is not renormalized so t carries over
+                ray local = ray(
+                    vec3(dot(inst.to_object[0], vec4(r.origin, 1.0f)),
+                         dot(inst.to_object[1], vec4(r.origin, 1.0f)),
+                         dot(inst.to_object[2], vec4(r.origin, 1.0f))),
+                    vec3(dot(inst.to_object[0].xyz, r.direction),
+                         dot(inst.to_object[1].xyz, r.direction),
+                         dot(inst.to_object[2].xyz, r.direction))
+                );
+                if (object_hit(inst.root, local, t_min, closest, rec)) {
+                    found = true;
+                    rec.point = r.origin + closest * r.direction;
+                    rec.normal = normalize(rec.normal.x * inst.to_object[0].xyz
+                                         + rec.normal.y * inst.to_object[1].xyz
+                                         + rec.normal.z * inst.to_object[2].xyz);
+                }
+            }
+            if (sp == 0) break;
+            node = stack[--sp];
+        } else {
+            int left = node + 1;
+            int right = nodes[node].next;
+            bool hl = node_hit(left, r, inv, t_min, closest, t_near);
+            bool hr = node_hit(right, r, inv, t_min, closest, t_far);
+            if (hl && hr) {
+                node = t_near <= t_far ? left : right;
+                stack[sp++] = t_near <= t_far ? right : left;
+            } else if (hl || hr) {
+                node = hl ? left : right;
+            } else {
+                if (sp == 0) break;
+                node = stack[--sp];
+            }
+        }
+    }
+
+    return found;
+}
+
+// Number of paths ending after each number of bounces, and the rays traced
+// and how paths ended, summed per work group first so only one global
+// atomic per counter is needed. Kernels including this need at least
+// PATH_HISTOGRAM invocations per group.
+#define RAY_PRIMARY 0
+#define RAY_BOUNCE 1
+#define RAY_SHADOW 2
+#define PATH_ESCAPED 3
+#define PATH_ABSORBED 4
+#define RAY_STATS 5
+
+layout(std430, binding = 12) buffer path_stats {
+    uint path_lengths[PATH_HISTOGRAM];
+    uint ray_stats[RAY_STATS];
+};
+
+shared uint group_lengths[PATH_HISTOGRAM];
+shared uint group_rays[RAY_STATS];
+
+// Counted per invocation, shared atomics only once at the end
+uint g_rays[RAY_STATS];
+
+// Called by every invocation before counting anything
+void begin_path_stats() {
+    if (gl_LocalInvocationIndex < PATH_HISTOGRAM) {
+        group_lengths[gl_LocalInvocationIndex] = 0u;
+    }
+    if (gl_LocalInvocationIndex < RAY_STATS) {
+        group_rays[gl_LocalInvocationIndex] = 0u;
+    }
+    for (int k = 0; k < RAY_STATS; k++) {
+        g_rays[k] = 0u;
+    }
+    barrier();
+}
+
+void count_path_length(int length) {
+    atomicAdd(group_lengths[min(length, PATH_HISTOGRAM - 1)], 1u);
+}
+
+void count_ray(int kind) {
+    g_rays[kind]++;
+}
+
+// Called by every invocation once it is done counting
+void end_path_stats() {
+    for (int k = 0; k < RAY_STATS; k++) {
+        if (g_rays[k] > 0u) {
+            atomicAdd(group_rays[k], g_rays[k]);
+        }
+    }
+    barrier();
+    if (gl_LocalInvocationIndex < PATH_HISTOGRAM && group_lengths[gl_LocalInvocationIndex] > 0u) {
+        atomicAdd(path_lengths[gl_LocalInvocationIndex], group_lengths[gl_LocalInvocationIndex]);
+    }
+    if (gl_LocalInvocationIndex < RAY_STATS && group_rays[gl_LocalInvocationIndex] > 0u) {
+        atomicAdd(ray_stats[gl_LocalInvocationIndex], group_rays[gl_LocalInvocationIndex]);
+    }
+}
+
+float power_heuristic(const float a, const float b) {
+    return a * a / (a * a + b * b);
+}
+
+// Solid angle pdf of sample_light picking a point of rect seen along
+// direction d at distance dist
+float light_pdf(const rectangle rect, const vec3 d, const float dist) {
+    vec3 ln = rect.type == RECT_XY ? vec3(0, 0, 1) : rect.type == RECT_XZ ? vec3(0, 1, 0) : vec3(1, 0, 0);
+    float area = (rect.a1 - rect.a0) * (rect.b1 - rect.b0);
+    return dist * dist / (abs(dot(ln, d)) * area * float(lights.length()));
+}
+
+// Next event estimation from a non-delta hit: light from a point picked
+// uniformly on an emissive rect, itself picked uniformly, weighted against
+// the BSDF having picked the same direction. attn is the hit's scatter
+// attenuation, which times the BSDF pdf is the BSDF times cosine.
+vec3 sample_light(const ray r, const hit rec, const vec3 attn) {
+    int count = lights.length();
+    if (count == 0) {
+        return vec3(0.0f);
+    }
+
+    vec3 h = sample3f();
+    rectangle rect = rects[lights[min(int(h.x * float(count)), count - 1)]];
+    float a = mix(rect.a0, rect.a1, h.y);
+    float b = mix(rect.b0, rect.b1, h.z);
+    vec3 q = rect.type == RECT_XY ? vec3(a, b, rect.k) : rect.type == RECT_XZ ? vec3(a, rect.k, b) : vec3(rect.k, a, b);
+
+    vec3 d = q - rec.point;
+    float dist = length(d);
+    d /= dist;
+    float pdf_bsdf = dispatch_pdf(r, rec, d);
+    float pdf_light = light_pdf(rect, d, dist);
+    if (pdf_bsdf <= 0.0f || isinf(pdf_light)) {
+        return vec3(0.0f);
+    }
+
+    hit shadow;
+    count_ray(RAY_SHADOW);
+    if (world(ray(rec.point, d), 0.01, dist - 0.01, shadow)) {
+        return vec3(0.0f);
+    }
+
+    vec3 emit = texture_color(materials[rect.mat].emit, h.yz);
+    return emit * attn * (pdf_bsdf / pdf_light * power_heuristic(pdf_light, pdf_bsdf));
+}
+
+//
+// PATHS
+//
+
+// Bounce i of a path along r, which hit info. Adds the light gathered there
+// times the throughput col to emitted, then moves r, col and pdf (of the
+// bounce that produced r) on to the next bounce. Returns false when the
+// path ends here, length is its number of bounces either way.
+bool shade_hit(inout ray r, const hit info, int i, inout vec3 col, inout vec3 emitted, inout float pdf, out int length) {
+    ray scattered;
+    vec3 attenuation;
+    vec3 emit = dispatch_emit(info);
+    if (pdf > 0.0f && (info.prim & 3) == PRIM_RECT) {
+        // Emissive rects may also have been reached by sample_light
+        float pdf_light = light_pdf(rects[info.prim >> 2], r.direction, info.t);
+        emit *= isinf(pdf_light) ? 1.0f : power_heuristic(pdf, pdf_light);
+    }
+    emitted += col * emit;
+
+    length = i;
+    if (!dispatch_scatter(r, info, attenuation, scattered, pdf)) {
+        count_ray(PATH_ABSORBED);
+        return false;
+    }
+    if (pdf > 0.0f) {
+        emitted += col * sample_light(r, info, attenuation);
+    }
+    col *= attenuation;
+    r = scattered;
+
+    // Russian roulette, survivors are reweighted so the estimate stays
+    // unbiased
+    length = i + 1;
+    if (i + 1 >= rr_depth) {
+        float q = min(max(col.r, max(col.g, col.b)), 0.95f);
+        if (sample1f() >= q) {
+            count_ray(PATH_ABSORBED);
+            return false;
+        }
+        col /= q;
+    }
+    return true;
+}
+
+// Traces a whole path from r, returning the light it gathers
+vec3 trace(ray r) {
+
+    hit info;
+    vec3 emitted = vec3(0.0f);
+    vec3 col = vec3(1.0f);
+
+    // Pdf of the bounce that produced r, 0 for camera rays and delta
+    // bounces which light sampling can never produce
+    float pdf = 0.0f;
+    
+    int i = 0;
+    for (; i < TRACE_DEPTH; i++) {
+        count_ray(i == 0 ? RAY_PRIMARY : RAY_BOUNCE);
+        if (!world(r, 0.01, 1.0f/0.0f, info)) {
+            count_ray(PATH_ESCAPED);
+            break;
+        }
+
+        int length;
+        if (!shade_hit(r, info, i, col, emitted, pdf, length)) {
+            i = length;
+            break;
+        }
+    }
+
+    count_path_length(i);
+    return emitted;
+}
+
+//
+// OUTPUT
+//
+
+layout(binding = 0, rgba8) uniform image2D dest;
+layout(binding = 1, rgba32f) uniform image2D src;
+layout(binding = 2, r32f) uniform image2D moment;
+
+// Pixels that still need samples, compacted by compact.comp. The header
+// doubles as the glDispatchComputeIndirect arguments.
+layout(std430, binding = 13) readonly buffer pixel_list {
+    uvec3 num_groups;
+    uint num_pixels;
+    uint error_sum;
+    uint list_pad[3];
+    uint pixels[];
+};
+
+float luminance(vec3 c) {
+    return dot(c, vec3(0.2126f, 0.7152f, 0.0722f));
+}
+
+uvec2 pixel_position(uint pixel) {
+    return uvec2(pixel % uint(TRACE_WIDTH), pixel / uint(TRACE_WIDTH));
+}
+
+// Starts sample index of a pixel at pos, returning its camera ray
+ray camera_ray(uint pixel, uvec2 pos, uint index) {
+    sampler_start(pixel, index, uint(i_seed));
+    vec2 s = (vec2(pos) + sample2f()) / vec2(TRACE_WIDTH, TRACE_HEIGHT);
+    return get_ray(s);
+}
+
+// Adds a frame's samples to a pixel and displays its new average. col is
+// the sum of the samples and sq the sum of their squared luminance.
+void accumulate(uvec2 pos, vec3 col, float sq, int count) {
+    vec4 total = imageLoad(src, ivec2(pos)) + vec4(col, float(count));
+    float total_sq = imageLoad(moment, ivec2(pos)).r + sq;
+
+    // Average
+    col = total.rgb / total.a;
+
+    // Gamma correction
+    col = vec3(sqrt(col.x), sqrt(col.y), sqrt(col.z));
+
+    imageStore(src, ivec2(pos), total);
+    imageStore(moment, ivec2(pos), vec4(total_sq));
+    imageStore(dest, ivec2(pos), vec4(col, 1.0));
+}
@@ -0,0 +1,92 @@
+// Wavefront path tracing. generate.comp starts a path for every listed
+// pixel, then extend.comp (intersection) and shade.comp (materials, light
+// sampling and Russian roulette) take turns once per bounce, handing the
+// paths to each other through two queues. accumulate.comp adds the frame's
+// samples to the image at the end. Each kernel only runs the work that is
+// left, so no invocation idles while its neighbours finish longer paths.
+
+#include "tracer.glsl"
+
+// A path per listed pixel, indexed like pixel_list
+struct path {
+    vec3 origin;
+    float pdf;          // Of the bounce that produced the ray
+    vec3 direction;
+    uint pixel;
+    vec3 throughput;
+    uint index;         // Sample being taken in the pixel's sequence
+    vec3 radiance;
+    uint dim;           // Sampler calls made so far
+    vec3 sum;           // Finished samples of this frame
+    float sum_sq;       // Their squared luminance
+    vec3 point;         // Hit found by extend.comp
+    float t;
+    vec3 normal;
+    int mat;
+    vec2 uv;
+    int prim;
+    int bounce;
+};
+
+layout(std430, binding = 15) buffer wavefront_paths {
+    path paths[];
+};
+
+// Rays waiting for extend.comp, hits waiting for shade.comp and, with
+// --sort-materials, the same hits binned by material type by sort.comp.
+// Each header doubles as the arguments of the indirect dispatch draining
+// its queue, the host resets them to { 0, 1, 1, 0 } along with the
+// material counts.
+layout(std430, binding = 16) buffer wavefront_queues {
+    uvec3 ray_groups;
+    uint ray_count;
+    uvec3 hit_groups;
+    uint hit_count;
+    uint material_counts[MATERIAL_TYPES];
+    uint material_next[MATERIAL_TYPES];
+
+    // Distinct material types summed over shading groups, drained by the
+    // host to report the divergence sorting removes
+    uint shade_groups;
+    uint shade_branches;
+    uint unsorted_branches;
+    uint pad;
+
+    uint queue_slots[];
+};
+
+// The queues follow each other in queue_slots, with room for a path per
+// pixel each
+uint hit_queue() {
+    return uint(TRACE_WIDTH) * uint(TRACE_HEIGHT);
+}
+
+uint sorted_queue() {
+    return 2u * uint(TRACE_WIDTH) * uint(TRACE_HEIGHT);
+}
+
+// Material types seen by the group, the number of branches of
+// dispatch_scatter() it runs through
+shared uint group_materials;
+
+void push_ray(uint slot) {
+    uint i = atomicAdd(ray_count, 1u);
+    queue_slots[i] = slot;
+    atomicMax(ray_groups.x, i / PIXEL_GROUP + 1u);
+}
+
+void push_hit(uint slot, int type) {
+    atomicAdd(material_counts[type], 1u);
+    uint i = atomicAdd(hit_count, 1u);
+    queue_slots[hit_queue() + i] = slot;
+    atomicMax(hit_groups.x, i / PIXEL_GROUP + 1u);
+}
+
+// Adds the path's sample to its pixel's sums for the frame
+void finish_path(uint slot, int length) {
+    vec3 c = paths[slot].radiance;
+    float l = luminance(c);
+    paths[slot].sum += c;
+    paths[slot].sum_sq += l * l;
+    count_path_length(length);
+}
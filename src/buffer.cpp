@@ -0,0 +1,93 @@
+#include "buffer.h"
+
+#include <string.h>
+
+#define PERSISTENT_FLAGS (GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT)
+
+Buffer::Buffer(GLenum target) {
+    this->m_buffer = 0;
+    this->m_target = target;
+    this->m_size = 0;
+    this->m_mapped = NULL;
+}
+
+Buffer::~Buffer() {
+    this->release();
+}
+
+void Buffer::release() {
+    if (this->m_mapped) {
+        glBindBuffer(this->m_target, this->m_buffer);
+        glUnmapBuffer(this->m_target);
+        glBindBuffer(this->m_target, 0);
+        this->m_mapped = NULL;
+    }
+    glDeleteBuffers(1, &this->m_buffer);
+    this->m_buffer = 0;
+    this->m_size = 0;
+}
+
+void Buffer::upload(const void* data, size_t size, GLenum usage) {
+    if (!this->m_buffer) {
+        glGenBuffers(1, &this->m_buffer);
+    }
+
+    // Zero sized buffers cannot be bound, keep at least one word around
+    glBindBuffer(this->m_target, this->m_buffer);
+    glBufferData(this->m_target, size ? size : sizeof(uint32_t), size ? data : NULL, usage);
+    glBindBuffer(this->m_target, 0);
+    this->m_size = size;
+}
+
+void* Buffer::storage(const void* data, size_t size) {
+    if (!GLEW_VERSION_4_4 && !GLEW_ARB_buffer_storage) {
+        this->upload(data, size);
+        return NULL;
+    }
+
+    // Immutable storage cannot be resized, start from a fresh buffer
+    this->release();
+    glGenBuffers(1, &this->m_buffer);
+
+    size_t bytes = size ? size : sizeof(uint32_t);
+    glBindBuffer(this->m_target, this->m_buffer);
+    glBufferStorage(this->m_target, bytes, NULL, PERSISTENT_FLAGS);
+    this->m_mapped = glMapBufferRange(this->m_target, 0, bytes, PERSISTENT_FLAGS);
+    glBindBuffer(this->m_target, 0);
+    this->m_size = size;
+
+    if (this->m_mapped && data && size) {
+        memcpy(this->m_mapped, data, size);
+    }
+    return this->m_mapped;
+}
+
+void Buffer::bind(unsigned int slot) {
+    glBindBufferBase(this->m_target, slot, this->m_buffer);
+}
+
+void Buffer::write(const void* data, size_t size, size_t offset) {
+    glBindBuffer(this->m_target, this->m_buffer);
+    glBufferSubData(this->m_target, offset, size, data);
+    glBindBuffer(this->m_target, 0);
+}
+
+void Buffer::zero(size_t size, size_t offset) {
+    glBindBuffer(this->m_target, this->m_buffer);
+    glClearBufferSubData(this->m_target, GL_R32UI, offset, size, GL_RED_INTEGER, GL_UNSIGNED_INT, NULL);
+    glBindBuffer(this->m_target, 0);
+}
+
+void Buffer::read(void* data, size_t size, size_t offset) {
+    glBindBuffer(this->m_target, this->m_buffer);
+    glGetBufferSubData(this->m_target, offset, size, data);
+    glBindBuffer(this->m_target, 0);
+}
+
+void Buffer::copy(const Buffer &src, size_t size, size_t src_offset, size_t offset) {
+    glBindBuffer(GL_COPY_READ_BUFFER, src.m_buffer);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, this->m_buffer);
+    glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, src_offset, offset, size);
+    glBindBuffer(GL_COPY_READ_BUFFER, 0);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+}
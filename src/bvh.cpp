@@ -0,0 +1,157 @@
+#include "bvh.h"
+
+#include <algorithm>
+
+void BVH::build(const std::vector<AABB> &boxes, const std::vector<int32_t> &refs) {
+    std::vector<Build> items;
+    items.reserve(boxes.size());
+    for (size_t i = 0; i < boxes.size(); i++) {
+        items.push_back({ boxes[i], boxes[i].center(), refs[i] });
+    }
+
+    this->nodes.clear();
+    this->prims.clear();
+    this->nodes.reserve(items.size() * 2);
+    this->prims.reserve(items.size());
+
+    if (items.empty()) {
+        // Inverted root box that no ray can hit
+        AABB empty;
+        BVHNode root = {
+            { empty.min[0], empty.min[1], empty.min[2] }, 0,
+            { empty.max[0], empty.max[1], empty.max[2] }, 0
+        };
+        this->nodes.push_back(root);
+        return;
+    }
+    this->build_node(items, 0, (int) items.size(), 0);
+}
+
+int32_t BVH::build_node(std::vector<Build> &items, int begin, int end, int depth) {
+    AABB bounds, centers;
+    for (int i = begin; i < end; i++) {
+        bounds.grow(items[i].box);
+        centers.grow(items[i].center);
+    }
+
+    int32_t index = (int32_t) this->nodes.size();
+    BVHNode node = {
+        { bounds.min[0], bounds.min[1], bounds.min[2] }, 0,
+        { bounds.max[0], bounds.max[1], bounds.max[2] }, 0
+    };
+    this->nodes.push_back(node);
+
+    int count = end - begin;
+    int axis = -1;
+    int split = 0;
+    float best = INFINITY;
+
+    // Binned SAH: bucket centroids along each axis and sweep for the
+    // cheapest split plane.
+    if (count > 1 && depth < BVH_MAX_DEPTH) {
+        for (int a = 0; a < 3; a++) {
+            float extent = centers.max[a] - centers.min[a];
+            if (extent <= 0.0f) {
+                continue;
+            }
+
+            AABB boxes[BVH_BINS];
+            int counts[BVH_BINS] = { 0 };
+            float scale = BVH_BINS / extent;
+            for (int i = begin; i < end; i++) {
+                int b = std::min(BVH_BINS - 1, (int) ((items[i].center[a] - centers.min[a]) * scale));
+                boxes[b].grow(items[i].box);
+                counts[b]++;
+            }
+
+            float right_area[BVH_BINS];
+            int right_count[BVH_BINS];
+            AABB acc;
+            int n = 0;
+            for (int b = BVH_BINS - 1; b > 0; b--) {
+                acc.grow(boxes[b]);
+                n += counts[b];
+                right_area[b] = acc.area();
+                right_count[b] = n;
+            }
+
+            acc = AABB();
+            n = 0;
+            for (int b = 0; b < BVH_BINS - 1; b++) {
+                acc.grow(boxes[b]);
+                n += counts[b];
+                if (n == 0 || right_count[b + 1] == 0) {
+                    continue;
+                }
+                float cost = acc.area() * n + right_area[b + 1] * right_count[b + 1];
+                if (cost < best) {
+                    best = cost;
+                    axis = a;
+                    split = b;
+                }
+            }
+        }
+    }
+
+    // Leaf if splitting costs more than intersecting everything here
+    float leaf_cost = bounds.area() * count;
+    float split_cost = bounds.area() + best;
+    if (count == 1 || depth >= BVH_MAX_DEPTH || (count <= BVH_MAX_LEAF && (axis < 0 || split_cost >= leaf_cost))) {
+        this->nodes[index].next = (int32_t) this->prims.size();
+        this->nodes[index].count = count;
+        for (int i = begin; i < end; i++) {
+            this->prims.push_back(items[i].ref);
+        }
+        return index;
+    }
+
+    int mid;
+    if (axis >= 0) {
+        float extent = centers.max[axis] - centers.min[axis];
+        float scale = BVH_BINS / extent;
+        float min = centers.min[axis];
+        mid = (int) (std::partition(items.begin() + begin, items.begin() + end, [=](const Build &b) {
+            return std::min(BVH_BINS - 1, (int) ((b.center[axis] - min) * scale)) <= split;
+        }) - items.begin());
+    } else {
+        // Every centroid coincides, split down the middle
+        mid = begin + count / 2;
+    }
+
+    this->build_node(items, begin, mid, depth + 1);
+    int32_t right = this->build_node(items, mid, end, depth + 1);
+    this->nodes[index].next = right;
+    return index;
+}
+
+int32_t BVH::append(std::vector<BVHNode> &nodes, std::vector<int32_t> &prims) const {
+    int32_t node_offset = (int32_t) nodes.size();
+    int32_t prim_offset = (int32_t) prims.size();
+    for (BVHNode node : this->nodes) {
+        node.next += node.count > 0 ? prim_offset : node_offset;
+        nodes.push_back(node);
+    }
+    prims.insert(prims.end(), this->prims.begin(), this->prims.end());
+    return node_offset;
+}
+
+int bvh_depth(const BVHNode* nodes, size_t count, int32_t root) {
+    int deepest = 0;
+    std::vector<std::pair<int32_t, int>> stack;
+    stack.push_back(std::make_pair(root, 1));
+    while (!stack.empty()) {
+        std::pair<int32_t, int> top = stack.back();
+        stack.pop_back();
+        if (top.first < 0 || (size_t) top.first >= count) {
+            return -1;
+        }
+        const BVHNode &n = nodes[top.first];
+        if (n.count > 0 || n.next <= top.first) {
+            deepest = std::max(deepest, top.second);
+        } else {
+            stack.push_back(std::make_pair(top.first + 1, top.second + 1));
+            stack.push_back(std::make_pair(n.next, top.second + 1));
+        }
+    }
+    return deepest;
+}
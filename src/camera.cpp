@@ -1,5 +1,7 @@
 #include "camera.h"
 
+#include <string.h>
+
 Camera::Camera(vec3 position, vec3 lookat, vec3 up, float fov, float aspect, float aperature, float focus) {
     this->fov = fov;
     this->aspect = aspect;
@@ -25,12 +27,20 @@ void Camera::update(vec3 position, vec3 lookat, vec3 up) {
     this->up = 2 * hh * focus * v;
 }
 
-void Camera::update_shader(Shader &shader) {
-    shader.uniform_vec3("cam.lower_left", this->lower_left);
-    shader.uniform_vec3("cam.origin", this->origin);
-    shader.uniform_vec3("cam.right", this->right);
-    shader.uniform_vec3("cam.up", this->up);
-    shader.uniform_vec3("cam.u", this->u);
-    shader.uniform_vec3("cam.v", this->v);
-    shader.uniform_float("cam.lens", this->lens);
-}
\ No newline at end of file
+void Camera::write_block(CameraBlock &block) const {
+    memset(&block, 0, sizeof(block));
+    memcpy(block.lower_left, this->lower_left.e, sizeof(this->lower_left.e));
+    memcpy(block.right, this->right.e, sizeof(this->right.e));
+    memcpy(block.up, this->up.e, sizeof(this->up.e));
+    memcpy(block.origin, this->origin.e, sizeof(this->origin.e));
+    memcpy(block.u, this->u.e, sizeof(this->u.e));
+    memcpy(block.v, this->v.e, sizeof(this->v.e));
+    block.lens = this->lens;
+}
+
+void Camera::get_ray(float s, float t, float dx, float dy, vec3 &origin, vec3 &direction) const {
+    vec3 off = (this->lens * dx * this->u) + (this->lens * dy * this->v);
+
+    origin = this->origin + off;
+    direction = (this->lower_left + (s * this->right) + (t * this->up) - this->origin - off).normalize();
+}
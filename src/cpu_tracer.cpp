@@ -0,0 +1,797 @@
+#include "cpu_tracer.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <thread>
+
+#include <SOIL.h>
+
+// Square tiles handed out to worker threads, small enough to balance the
+// load across cores while keeping each thread's pixels close together
+#define TILE_SIZE 32
+
+//
+//  Hash Functions
+//
+
+static inline uint32_t hash(uint32_t x, uint32_t y) {
+    uint32_t px = 1103515245U * ((x >> 1U) ^ y);
+    uint32_t py = 1103515245U * ((y >> 1U) ^ x);
+    uint32_t h32 = 1103515245U * (px ^ (py >> 3U));
+    return h32 ^ (h32 >> 16);
+}
+
+struct rng {
+    uint32_t state;
+
+    float next() {
+        state = state * 747796405U + 2891336453U;
+        uint32_t word = ((state >> ((state >> 28U) + 4U)) ^ state) * 277803737U;
+        word = (word >> 22U) ^ word;
+        return (word >> 8) * (1.0f / 16777216.0f);
+    }
+};
+
+static vec3 unit_sphere(rng &g) {
+    float z = g.next() * 2.0f - 1.0f;
+    float phi = g.next() * 2.0f * MATH_PI;
+    float r = cbrtf(g.next());
+    float s = sqrtf(1.0f - z * z);
+    return r * vec3(s * sinf(phi), s * cosf(phi), z);
+}
+
+static void unit_disk(rng &g, float &x, float &y) {
+    float r = sqrtf(g.next());
+    float phi = g.next() * 2.0f * MATH_PI;
+    x = r * sinf(phi);
+    y = r * cosf(phi);
+}
+
+static vec3 unit_hemisphere(const vec3 &n, rng &g) {
+    float r0 = g.next();
+    float r1 = g.next();
+    vec3 uu = n.cross(fabsf(n[1]) > 0.5f ? vec3(1.0f, 0.0f, 0.0f) : vec3(0.0f, 1.0f, 0.0f)).normalize();
+    vec3 vv = uu.cross(n);
+    float ra = sqrtf(r1);
+    float rx = ra * cosf(2.0f * MATH_PI * r0);
+    float ry = ra * sinf(2.0f * MATH_PI * r0);
+    float rz = sqrtf(1.0f - r1);
+    return (rx * uu + ry * vv + rz * n).normalize();
+}
+
+//
+// RAY
+//
+
+struct ray {
+    vec3 origin;
+    vec3 direction;
+};
+
+struct hit {
+    float t;
+    vec3 point;
+    vec3 normal;
+    float u, v;
+    int material;
+    int prim;
+};
+
+static inline vec3 reflect(const vec3 &i, const vec3 &n) {
+    return i - 2.0f * n.dot(i) * n;
+}
+
+//
+// SPHERES
+//
+
+// The direction need not be normalized, rays inside instances are scaled
+static bool hit_sphere(const Sphere &s, const ray &r, float t_min, float t_max, hit &h) {
+    vec3 oc = r.origin - s.center;
+    float a = r.direction.dot(r.direction);
+    float b = oc.dot(r.direction);
+    float c = oc.dot(oc) - (s.radius * s.radius);
+    float d = b * b - a * c;
+    if (d < 0.0f) return false;
+
+    float sq = sqrtf(d);
+    float t1 = (-b - sq) / a;
+    float t2 = (-b + sq) / a;
+
+    float t = t1 < t_min ? t2 : t1;
+    if (t >= t_max || t <= t_min) {
+        return false;
+    }
+
+    h.t = t;
+    h.point = r.origin + t * r.direction;
+    h.normal = (h.point - s.center) / s.radius;
+    h.material = s.material;
+
+    float phi = atan2f(h.normal[2], h.normal[0]);
+    float theta = asinf(fminf(fmaxf(h.normal[1], -1.0f), 1.0f));
+    h.u = 1.0f - (phi + MATH_PI) / (2.0f * MATH_PI);
+    h.v = (theta + (MATH_PI / 2.0f)) / MATH_PI;
+    return true;
+}
+
+//
+// RECTANGLES
+//
+
+static bool hit_rect(const Rect &rect, const ray &r, float t_min, float t_max, hit &h) {
+    int k_axis, a_axis, b_axis;
+    if (rect.type == RECT_XY) {
+        k_axis = 2; a_axis = 0; b_axis = 1;
+    } else if (rect.type == RECT_XZ) {
+        k_axis = 1; a_axis = 0; b_axis = 2;
+    } else {
+        k_axis = 0; a_axis = 1; b_axis = 2;
+    }
+
+    float t = (rect.k - r.origin[k_axis]) / r.direction[k_axis];
+    if (!(t >= t_min && t <= t_max)) {
+        return false;
+    }
+
+    vec3 p = r.origin + t * r.direction;
+    float a = p[a_axis];
+    float b = p[b_axis];
+    if (a < rect.a0 || a > rect.a1 || b < rect.b0 || b > rect.b1) {
+        return false;
+    }
+
+    vec3 n(0.0f);
+    n[k_axis] = 1.0f;
+    h.t = t;
+    h.point = p;
+    h.normal = r.direction.dot(n) < 0.0f ? n : -n;
+    h.u = (a - rect.a0) / (rect.a1 - rect.a0);
+    h.v = (b - rect.b0) / (rect.b1 - rect.b0);
+    h.material = rect.material;
+    return true;
+}
+
+//
+// TRIANGLES
+//
+
+// Per-ray constants of the watertight ray/triangle test (Woop et al. 2013)
+struct watertight {
+    int kx, ky, kz;
+    float sx, sy, sz;
+};
+
+static watertight watertight_setup(const ray &r) {
+    float dx = fabsf(r.direction[0]);
+    float dy = fabsf(r.direction[1]);
+    float dz = fabsf(r.direction[2]);
+    watertight w;
+    w.kz = dx > dy ? (dx > dz ? 0 : 2) : (dy > dz ? 1 : 2);
+    w.kx = w.kz == 2 ? 0 : w.kz + 1;
+    w.ky = w.kx == 2 ? 0 : w.kx + 1;
+    if (r.direction[w.kz] < 0.0f) {
+        int tmp = w.kx;
+        w.kx = w.ky;
+        w.ky = tmp;
+    }
+    w.sx = r.direction[w.kx] / r.direction[w.kz];
+    w.sy = r.direction[w.ky] / r.direction[w.kz];
+    w.sz = 1.0f / r.direction[w.kz];
+    return w;
+}
+
+static inline vec3 vertex(const ArrayView<float> &a, int32_t i) {
+    return vec3(a[(size_t) i * 3], a[(size_t) i * 3 + 1], a[(size_t) i * 3 + 2]);
+}
+
+static bool hit_triangle(const Scene &scene, int32_t index, const ray &r, const watertight &w,
+                         float t_min, float t_max, hit &h) {
+    const Triangle &tri = scene.triangles[index];
+    vec3 p0 = vertex(scene.positions, tri.p[0]);
+    vec3 p1 = vertex(scene.positions, tri.p[1]);
+    vec3 p2 = vertex(scene.positions, tri.p[2]);
+
+    // Shear and scale the vertices into ray space
+    vec3 a = p0 - r.origin;
+    vec3 b = p1 - r.origin;
+    vec3 c = p2 - r.origin;
+    float ax = a[w.kx] - w.sx * a[w.kz];
+    float ay = a[w.ky] - w.sy * a[w.kz];
+    float bx = b[w.kx] - w.sx * b[w.kz];
+    float by = b[w.ky] - w.sy * b[w.kz];
+    float cx = c[w.kx] - w.sx * c[w.kz];
+    float cy = c[w.ky] - w.sy * c[w.kz];
+
+    // Scaled barycentrics, an edge hit counts for exactly one triangle
+    float u = cx * by - cy * bx;
+    float v = ax * cy - ay * cx;
+    float e = bx * ay - by * ax;
+
+    // Edges through the ray are resolved in double precision
+    if (u == 0.0f || v == 0.0f || e == 0.0f) {
+        u = (float) ((double) cx * by - (double) cy * bx);
+        v = (float) ((double) ax * cy - (double) ay * cx);
+        e = (float) ((double) bx * ay - (double) by * ax);
+    }
+    if ((u < 0.0f || v < 0.0f || e < 0.0f) && (u > 0.0f || v > 0.0f || e > 0.0f)) {
+        return false;
+    }
+    float det = u + v + e;
+    if (det == 0.0f) {
+        return false;
+    }
+
+    float t = (u * a[w.kz] + v * b[w.kz] + e * c[w.kz]) * w.sz / det;
+    if (t <= t_min || t >= t_max) {
+        return false;
+    }
+
+    float b0 = u / det;
+    float b1 = v / det;
+    float b2 = e / det;
+    h.t = t;
+    h.point = r.origin + t * r.direction;
+    if (tri.n[0] >= 0) {
+        h.normal = (b0 * vertex(scene.normals, tri.n[0]) + b1 * vertex(scene.normals, tri.n[1])
+            + b2 * vertex(scene.normals, tri.n[2])).normalize();
+    } else {
+        h.normal = (p1 - p0).cross(p2 - p0).normalize();
+    }
+    if (tri.t[0] >= 0) {
+        h.u = b0 * scene.uvs[tri.t[0] * 2] + b1 * scene.uvs[tri.t[1] * 2] + b2 * scene.uvs[tri.t[2] * 2];
+        h.v = b0 * scene.uvs[tri.t[0] * 2 + 1] + b1 * scene.uvs[tri.t[1] * 2 + 1] + b2 * scene.uvs[tri.t[2] * 2 + 1];
+    } else {
+        h.u = b1;
+        h.v = b2;
+    }
+    h.material = tri.material;
+    return true;
+}
+
+// Slab test against a node's box, narrowing [t_min, t_max] to the overlap
+static inline bool node_hit(const BVHNode &n, const ray &r, const vec3 &inv, float t_min, float t_max, float &t_enter) {
+    for (int i = 0; i < 3; i++) {
+        float t0 = (n.min[i] - r.origin[i]) * inv[i];
+        float t1 = (n.max[i] - r.origin[i]) * inv[i];
+        if (inv[i] < 0.0f) {
+            float tmp = t0;
+            t0 = t1;
+            t1 = tmp;
+        }
+        t_min = t0 > t_min ? t0 : t_min;
+        t_max = t1 < t_max ? t1 : t_max;
+        if (t_max < t_min) {
+            return false;
+        }
+    }
+    t_enter = t_min;
+    return true;
+}
+
+// Closest hit in one object's BVH, r is in the object's space
+static bool object_hit(const Scene &scene, int32_t root, const ray &r, float t_min, float &closest, hit &rec) {
+    bool found = false;
+
+    const BVHNode* nodes = scene.nodes.data;
+    vec3 inv(1.0f / r.direction[0], 1.0f / r.direction[1], 1.0f / r.direction[2]);
+    watertight w = watertight_setup(r);
+    float t_near, t_far;
+    if (!node_hit(nodes[root], r, inv, t_min, closest, t_near)) {
+        return false;
+    }
+
+    int32_t stack[BVH_MAX_DEPTH];
+    int sp = 0;
+    int32_t node = root;
+    while (true) {
+        const BVHNode &n = nodes[node];
+        if (n.count > 0) {
+            for (int32_t i = n.next; i < n.next + n.count; i++) {
+                int32_t ref = scene.prims[i];
+                int32_t index = PRIM_INDEX(ref);
+                bool h;
+                switch (PRIM_KIND(ref)) {
+                    case PRIM_SPHERE:
+                        h = hit_sphere(scene.spheres[index], r, t_min, closest, rec);
+                        break;
+                    case PRIM_RECT:
+                        h = hit_rect(scene.rects[index], r, t_min, closest, rec);
+                        break;
+                    default:
+                        h = hit_triangle(scene, index, r, w, t_min, closest, rec);
+                        break;
+                }
+                if (h) {
+                    found = true;
+                    rec.prim = ref;
+                    closest = rec.t;
+                }
+            }
+            if (sp == 0) break;
+            node = stack[--sp];
+        } else {
+            int32_t left = node + 1;
+            int32_t right = n.next;
+            bool hl = node_hit(nodes[left], r, inv, t_min, closest, t_near);
+            bool hr = node_hit(nodes[right], r, inv, t_min, closest, t_far);
+            if (hl && hr) {
+                node = t_near <= t_far ? left : right;
+                stack[sp++] = t_near <= t_far ? right : left;
+            } else if (hl || hr) {
+                node = hl ? left : right;
+            } else {
+                if (sp == 0) break;
+                node = stack[--sp];
+            }
+        }
+    }
+
+    return found;
+}
+
+// Closest hit among the instances, whose leaves hold instance indices
+static bool world(const Scene &scene, const ray &r, float t_min, float t_max, hit &rec) {
+    bool found = false;
+    float closest = t_max;
+
+    const BVHNode* nodes = scene.nodes.data;
+    vec3 inv(1.0f / r.direction[0], 1.0f / r.direction[1], 1.0f / r.direction[2]);
+    float t_near, t_far;
+    if (!node_hit(nodes[0], r, inv, t_min, closest, t_near)) {
+        return false;
+    }
+
+    int32_t stack[BVH_MAX_DEPTH];
+    int sp = 0;
+    int32_t node = 0;
+    while (true) {
+        const BVHNode &n = nodes[node];
+        if (n.count > 0) {
+            for (int32_t i = n.next; i < n.next + n.count; i++) {
+                const Instance &inst = scene.instances[scene.prims[i]];
+                const float* m = inst.to_object;
+
+                // The direction is not renormalized so t carries over
+                ray local;
+                local.origin = vec3(
+                    m[0] * r.origin[0] + m[1] * r.origin[1] + m[2] * r.origin[2] + m[3],
+                    m[4] * r.origin[0] + m[5] * r.origin[1] + m[6] * r.origin[2] + m[7],
+                    m[8] * r.origin[0] + m[9] * r.origin[1] + m[10] * r.origin[2] + m[11]
+                );
+                local.direction = vec3(
+                    m[0] * r.direction[0] + m[1] * r.direction[1] + m[2] * r.direction[2],
+                    m[4] * r.direction[0] + m[5] * r.direction[1] + m[6] * r.direction[2],
+                    m[8] * r.direction[0] + m[9] * r.direction[1] + m[10] * r.direction[2]
+                );
+                if (object_hit(scene, inst.root, local, t_min, closest, rec)) {
+                    found = true;
+                    vec3 on = rec.normal;
+                    rec.point = r.origin + closest * r.direction;
+                    rec.normal = vec3(
+                        m[0] * on[0] + m[4] * on[1] + m[8] * on[2],
+                        m[1] * on[0] + m[5] * on[1] + m[9] * on[2],
+                        m[2] * on[0] + m[6] * on[1] + m[10] * on[2]
+                    ).normalize();
+                }
+            }
+            if (sp == 0) break;
+            node = stack[--sp];
+        } else {
+            int32_t left = node + 1;
+            int32_t right = n.next;
+            bool hl = node_hit(nodes[left], r, inv, t_min, closest, t_near);
+            bool hr = node_hit(nodes[right], r, inv, t_min, closest, t_far);
+            if (hl && hr) {
+                node = t_near <= t_far ? left : right;
+                stack[sp++] = t_near <= t_far ? right : left;
+            } else if (hl || hr) {
+                node = hl ? left : right;
+            } else {
+                if (sp == 0) break;
+                node = stack[--sp];
+            }
+        }
+    }
+
+    return found;
+}
+
+//
+// MATERIALS
+//
+
+struct texture_image {
+    const unsigned char* texels;
+    int width;
+    int height;
+};
+
+struct scene_context {
+    const Scene* scene;
+    texture_image images[MAX_IMAGES];
+};
+
+static vec3 texel(const texture_image &img, int x, int y) {
+    x = ((x % img.width) + img.width) % img.width;
+    y = ((y % img.height) + img.height) % img.height;
+    const unsigned char* p = &img.texels[((size_t) y * img.width + x) * 3];
+    return vec3(p[0], p[1], p[2]) / 255.0;
+}
+
+static vec3 texture_color(const scene_context &ctx, int32_t index, float u, float v) {
+    const TextureDesc &t = ctx.scene->textures[index];
+    if (t.type != TEX_IMAGE || !ctx.images[t.image].texels) {
+        return t.color;
+    }
+    const texture_image &img = ctx.images[t.image];
+
+    // Bilinear, repeating lookup with v = 0 at the bottom like GL
+    float x = u * img.width - 0.5f;
+    float y = (1.0f - v) * img.height - 0.5f;
+    float fx = floorf(x);
+    float fy = floorf(y);
+    float ax = x - fx;
+    float ay = y - fy;
+    int x0 = (int) fx;
+    int y0 = (int) fy;
+
+    vec3 top = (1.0f - ax) * texel(img, x0, y0) + ax * texel(img, x0 + 1, y0);
+    vec3 bottom = (1.0f - ax) * texel(img, x0, y0 + 1) + ax * texel(img, x0 + 1, y0 + 1);
+    return (1.0f - ay) * top + ay * bottom;
+}
+
+static float schlick(float c, float r) {
+    float r0 = (1.0f - r) / (1.0f + r);
+    r0 = r0 * r0;
+    return r0 + (1.0f - r0) * powf(1.0f - c, 5.0f);
+}
+
+static bool mrefract(const vec3 &v, const vec3 &n, float s, vec3 &ref) {
+    float dt = v.dot(n);
+    float d = 1.0f - s * s * (1.0f - dt * dt);
+    if (d > 0.0f) {
+        ref = s * (v - n * dt) - n * sqrtf(d);
+        return true;
+    }
+    return false;
+}
+
+// Density of normalize(ref + fuzz * u) for u uniform in the unit ball: the
+// t^2 weighted length of the ray t * wi inside the fuzz ball over its volume
+static float metal_pdf(const vec3 &ref, float fuzz, const vec3 &wi) {
+    float b = wi.dot(ref);
+    float d = b * b - (1.0f - fuzz * fuzz);
+    if (d <= 0.0f) {
+        return 0.0f;
+    }
+    float sq = sqrtf(d);
+    float t0 = fmaxf(b - sq, 0.0f);
+    float t1 = fmaxf(b + sq, 0.0f);
+    return (t1 * t1 * t1 - t0 * t0 * t0) / (4.0f * MATH_PI * fuzz * fuzz * fuzz);
+}
+
+// Also reports the solid angle pdf of the picked direction, 0 if it came
+// from a delta distribution. Lambertian and metal are sampled in proportion
+// to BSDF times cosine, so attn * pdf is that product for any direction.
+static bool dispatch_scatter(const scene_context &ctx, const Material &mat, const ray &r, const hit &rec,
+                             rng &g, vec3 &attn, ray &scatter, float &pdf) {
+    if (mat.type == MAT_METAL) {
+        vec3 dir = r.direction;
+        vec3 ref = reflect(dir.normalize(), rec.normal);
+        scatter.origin = rec.point;
+        scatter.direction = (ref + (mat.v * unit_sphere(g))).normalize();
+        attn = texture_color(ctx, mat.albedo, rec.u, rec.v);
+        pdf = mat.v > 0.0f ? metal_pdf(ref, mat.v, scatter.direction) : 0.0f;
+        return true;
+    } else if (mat.type == MAT_DIELECTRIC) {
+        vec3 dir = r.direction;
+        dir.normalize();
+        vec3 refl = reflect(dir, rec.normal);
+        float ct = dir.dot(rec.normal);
+
+        attn = vec3(1.0f);
+        pdf = 0.0f;
+        vec3 outward = ct > 0.0f ? -rec.normal : rec.normal;
+        float s = ct > 0.0f ? mat.v : 1.0f / mat.v;
+        ct = ct > 0.0f ? sqrtf(fmaxf(1.0f - mat.v * mat.v * (1.0f - ct * ct), 0.0f)) : -ct;
+
+        vec3 refr;
+        float refp;
+        if (mrefract(dir, outward, s, refr)) {
+            refp = schlick(ct, mat.v);
+        } else {
+            refp = 1.0f;
+        }
+
+        scatter.origin = rec.point;
+        scatter.direction = g.next() < refp ? refl : refr;
+        return true;
+    } else if (mat.type == MAT_LAMBERTIAN) {
+        // Meshes keep their outward normal, so face it towards the ray
+        vec3 n = r.direction.dot(rec.normal) > 0.0f ? -rec.normal : rec.normal;
+        scatter.origin = rec.point;
+        scatter.direction = unit_hemisphere(n, g);
+        attn = texture_color(ctx, mat.albedo, rec.u, rec.v);
+        pdf = fmaxf(n.dot(scatter.direction), 0.0f) / MATH_PI;
+        return true;
+    }
+    return false;
+}
+
+// Solid angle pdf of scattering towards wi, for the non-delta materials
+static float dispatch_pdf(const Material &mat, const ray &r, const hit &rec, const vec3 &wi) {
+    if (mat.type == MAT_METAL) {
+        vec3 dir = r.direction;
+        return metal_pdf(reflect(dir.normalize(), rec.normal), mat.v, wi);
+    }
+    vec3 n = r.direction.dot(rec.normal) > 0.0f ? -rec.normal : rec.normal;
+    return fmaxf(n.dot(wi), 0.0f) / MATH_PI;
+}
+
+static vec3 dispatch_emit(const scene_context &ctx, const Material &mat, const hit &h) {
+    if (mat.type == MAT_DIFFUSE_LIGHT) {
+        return texture_color(ctx, mat.emit, h.u, h.v);
+    }
+    return vec3(0.0f);
+}
+
+static inline float power_heuristic(float a, float b) {
+    return a * a / (a * a + b * b);
+}
+
+// Solid angle pdf of sample_light picking a point of rect seen along
+// direction d at distance dist
+static float light_pdf(const Scene &scene, const Rect &rect, const vec3 &d, float dist) {
+    int k_axis = rect.type == RECT_XY ? 2 : rect.type == RECT_XZ ? 1 : 0;
+    float area = (rect.a1 - rect.a0) * (rect.b1 - rect.b0);
+    return dist * dist / (fabsf(d[k_axis]) * area * scene.lights.size());
+}
+
+// Next event estimation from a non-delta hit: light from a point picked
+// uniformly on an emissive rect, itself picked uniformly, weighted against
+// the BSDF having picked the same direction. attn is the hit's scatter
+// attenuation, which times the BSDF pdf is the BSDF times cosine.
+static vec3 sample_light(const scene_context &ctx, const Material &mat, const ray &r, const hit &rec,
+                         const vec3 &attn, rng &g) {
+    const Scene &scene = *ctx.scene;
+    int count = (int) scene.lights.size();
+    if (count == 0) {
+        return vec3(0.0f);
+    }
+
+    int pick = (int) (g.next() * count);
+    const Rect &rect = scene.rects[scene.lights[pick < count ? pick : count - 1]];
+    float su = g.next();
+    float sv = g.next();
+    float a = rect.a0 + su * (rect.a1 - rect.a0);
+    float b = rect.b0 + sv * (rect.b1 - rect.b0);
+    vec3 q;
+    if (rect.type == RECT_XY) {
+        q = vec3(a, b, rect.k);
+    } else if (rect.type == RECT_XZ) {
+        q = vec3(a, rect.k, b);
+    } else {
+        q = vec3(rect.k, a, b);
+    }
+
+    vec3 d = q - rec.point;
+    float dist = d.length();
+    d = d / dist;
+    float pdf_bsdf = dispatch_pdf(mat, r, rec, d);
+    float pdf_light = light_pdf(scene, rect, d, dist);
+    if (pdf_bsdf <= 0.0f || isinf(pdf_light)) {
+        return vec3(0.0f);
+    }
+
+    ray shadow = { rec.point, d };
+    hit h;
+    if (world(scene, shadow, 0.01f, dist - 0.01f, h)) {
+        return vec3(0.0f);
+    }
+
+    vec3 emit = texture_color(ctx, scene.materials[rect.material].emit, su, sv);
+    return emit * attn * (pdf_bsdf / pdf_light * power_heuristic(pdf_light, pdf_bsdf));
+}
+
+// length is set to the number of bounces the path took
+static vec3 trace(const scene_context &ctx, ray r, int depth, int rr_depth, rng &g, int &length) {
+    hit info;
+    vec3 emitted(0.0f);
+    vec3 col(1.0f);
+
+    // Pdf of the bounce that produced r, 0 for camera rays and delta
+    // bounces which light sampling can never produce
+    float pdf = 0.0f;
+
+    int i = 0;
+    for (; i < depth; i++) {
+        if (!world(*ctx.scene, r, 0.01f, INFINITY, info)) {
+            break;
+        }
+
+        const Material &mat = ctx.scene->materials[info.material];
+        ray scattered;
+        vec3 attenuation;
+        vec3 emit = dispatch_emit(ctx, mat, info);
+        if (pdf > 0.0f && PRIM_KIND(info.prim) == PRIM_RECT) {
+            // Emissive rects may also have been reached by sample_light
+            const Rect &rect = ctx.scene->rects[PRIM_INDEX(info.prim)];
+            float pdf_light = light_pdf(*ctx.scene, rect, r.direction, info.t);
+            emit = emit * (isinf(pdf_light) ? 1.0f : power_heuristic(pdf, pdf_light));
+        }
+        emitted += col * emit;
+
+        if (!dispatch_scatter(ctx, mat, r, info, g, attenuation, scattered, pdf)) {
+            break;
+        }
+        if (pdf > 0.0f) {
+            emitted += col * sample_light(ctx, mat, r, info, attenuation, g);
+        }
+        col *= attenuation;
+        r = scattered;
+
+        // Russian roulette, survivors are reweighted so the estimate stays
+        // unbiased
+        if (i + 1 >= rr_depth) {
+            float q = fminf(fmaxf(col[0], fmaxf(col[1], col[2])), 0.95f);
+            if (g.next() >= q) {
+                i++;
+                break;
+            }
+            col /= vec3(q);
+        }
+    }
+
+    length = i;
+    return emitted;
+}
+
+//
+// TRACER
+//
+
+CpuTracer::CpuTracer(const Scene &scene, int width, int height, int samples, int depth, int rr_depth, int threads, int seed) {
+    this->scene = &scene;
+    this->width = width;
+    this->height = height;
+    this->samples = samples;
+    this->depth = depth;
+    this->rr_depth = rr_depth;
+    this->threads = threads > 0 ? threads : (int) std::thread::hardware_concurrency();
+    if (this->threads <= 0) {
+        this->threads = 1;
+    }
+    this->n_render = 0;
+    this->seed = seed >= 0 ? (uint32_t) seed : (uint32_t) time(NULL);
+    this->gather.assign((size_t) width * height * 3, 0.0f);
+    this->lengths.assign(PATH_HISTOGRAM, 0);
+
+    float aspect = float(width) / float(height);
+    const CameraDesc &c = scene.camera;
+    this->camera = new Camera(c.position, c.lookat, c.up, c.fov, aspect, c.aperture, c.focus);
+}
+
+CpuTracer::~CpuTracer() {
+    delete this->camera;
+}
+
+int CpuTracer::load_textures() {
+    this->images.resize(this->scene->images.size());
+    for (size_t i = 0; i < this->scene->images.size(); i++) {
+        TextureImage &image = this->images[i];
+        int channels;
+        unsigned char* data = SOIL_load_image(
+            this->scene->images[i].c_str(),
+            &image.width,
+            &image.height,
+            &channels,
+            SOIL_LOAD_RGB
+        );
+        if (!data) {
+            printf("[Texture Error]\t%s\n", SOIL_last_result());
+            return -1;
+        }
+
+        image.texels.assign(data, data + (size_t) image.width * image.height * 3);
+        SOIL_free_image_data(data);
+    }
+    return 0;
+}
+
+void CpuTracer::render_tiles(uint32_t frame_seed, std::atomic<int> &next_tile) {
+    scene_context ctx = {};
+    ctx.scene = this->scene;
+    for (size_t i = 0; i < this->images.size(); i++) {
+        ctx.images[i].texels = this->images[i].texels.empty() ? NULL : this->images[i].texels.data();
+        ctx.images[i].width = this->images[i].width;
+        ctx.images[i].height = this->images[i].height;
+    }
+
+    uint64_t lengths[PATH_HISTOGRAM] = { 0 };
+    int tiles_x = (this->width + TILE_SIZE - 1) / TILE_SIZE;
+    int tiles_y = (this->height + TILE_SIZE - 1) / TILE_SIZE;
+    int tile;
+    while ((tile = next_tile.fetch_add(1)) < tiles_x * tiles_y) {
+        int x0 = (tile % tiles_x) * TILE_SIZE;
+        int y0 = (tile / tiles_x) * TILE_SIZE;
+
+        for (int y = y0; y < y0 + TILE_SIZE && y < this->height; y++) {
+            for (int x = x0; x < x0 + TILE_SIZE && x < this->width; x++) {
+                rng g = { hash(frame_seed * (uint32_t) x, frame_seed * (uint32_t) y) ^ hash(x, y) };
+
+                vec3 col(0.0f);
+                for (int i = 0; i < this->samples; i++) {
+                    float s = (float(x) + g.next()) / float(this->width);
+                    float t = (float(y) + g.next()) / float(this->height);
+                    float dx, dy;
+                    unit_disk(g, dx, dy);
+
+                    ray r;
+                    this->camera->get_ray(s, t, dx, dy, r.origin, r.direction);
+                    int length;
+                    col += trace(ctx, r, this->depth, this->rr_depth, g, length);
+                    lengths[length < PATH_HISTOGRAM ? length : PATH_HISTOGRAM - 1]++;
+                }
+
+                float* p = &this->gather[((size_t) y * this->width + x) * 3];
+                p[0] += col[0];
+                p[1] += col[1];
+                p[2] += col[2];
+            }
+        }
+    }
+
+    std::lock_guard<std::mutex> guard(this->lengths_lock);
+    for (int i = 0; i < PATH_HISTOGRAM; i++) {
+        this->lengths[i] += lengths[i];
+    }
+}
+
+void CpuTracer::render(int frames) {
+    for (int f = 0; f < frames; f++) {
+        this->seed = hash(this->seed, (uint32_t) this->n_render + 1U);
+        uint32_t frame_seed = this->seed | 1U;
+
+        std::atomic<int> next_tile(0);
+        std::vector<std::thread> workers;
+        for (int i = 0; i < this->threads; i++) {
+            workers.emplace_back(&CpuTracer::render_tiles, this, frame_seed, std::ref(next_tile));
+        }
+        for (std::thread &w : workers) {
+            w.join();
+        }
+        this->n_render++;
+    }
+}
+
+void CpuTracer::resolve(Image &out) const {
+    out = Image(this->width, this->height);
+    float n = float(this->n_render * this->samples);
+    if (n <= 0.0f) {
+        return;
+    }
+
+    // Row 0 of the gather buffer is the bottom of the image, like GL
+    for (int y = 0; y < this->height; y++) {
+        for (int x = 0; x < this->width; x++) {
+            const float* p = &this->gather[((size_t) y * this->width + x) * 3];
+            out.set(x, this->height - 1 - y, vec3(p[0], p[1], p[2]) / n);
+        }
+    }
+}
+
+int CpuTracer::frames() const {
+    return this->n_render;
+}
+
+int CpuTracer::thread_count() const {
+    return this->threads;
+}
+
+const std::vector<uint64_t>& CpuTracer::path_lengths() const {
+    return this->lengths;
+}
@@ -0,0 +1,86 @@
+#include "gpu_timer.h"
+
+#include <stdio.h>
+
+GpuTimer::GpuTimer() {
+    this->m_passes = 0;
+    this->m_pass = 0;
+    this->m_recorded = 0;
+    this->m_read = 0;
+    this->m_dropped = 0;
+}
+
+GpuTimer::~GpuTimer() {
+    if (this->m_passes) {
+        glDeleteQueries(TIMER_FRAMES * (TIMER_PASSES + 1), &this->m_queries[0][0]);
+    }
+}
+
+int GpuTimer::create(int passes) {
+    if (!GLEW_VERSION_3_3 && !GLEW_ARB_timer_query) {
+        fprintf(stderr, "ERROR: GPU timing needs GL 3.3 or ARB_timer_query\n");
+        return -1;
+    }
+    if (passes < 1 || passes > TIMER_PASSES) {
+        fprintf(stderr, "ERROR: GPU timer supports 1 to %d passes, not %d\n", TIMER_PASSES, passes);
+        return -1;
+    }
+
+    glGenQueries(TIMER_FRAMES * (TIMER_PASSES + 1), &this->m_queries[0][0]);
+    this->m_passes = passes;
+    return 0;
+}
+
+int GpuTimer::begin() {
+    if (!this->m_passes) {
+        return -1;
+    }
+
+    // Reusing a slot whose results never arrived loses them
+    if (this->m_recorded - this->m_read == TIMER_FRAMES) {
+        this->m_read++;
+        this->m_dropped++;
+    }
+
+    int slot = (int) (this->m_recorded % TIMER_FRAMES);
+    this->m_pass = 0;
+    glQueryCounter(this->m_queries[slot][0], GL_TIMESTAMP);
+    return slot;
+}
+
+void GpuTimer::mark() {
+    if (!this->m_passes || this->m_pass >= this->m_passes) {
+        return;
+    }
+
+    int slot = (int) (this->m_recorded % TIMER_FRAMES);
+    glQueryCounter(this->m_queries[slot][++this->m_pass], GL_TIMESTAMP);
+    if (this->m_pass == this->m_passes) {
+        this->m_recorded++;
+    }
+}
+
+int GpuTimer::poll(double* ms) {
+    if (this->m_read == this->m_recorded) {
+        return -1;
+    }
+
+    // Timestamps arrive in order, so the last one covers the frame
+    int slot = (int) (this->m_read % TIMER_FRAMES);
+    GLuint available = 0;
+    glGetQueryObjectuiv(this->m_queries[slot][this->m_passes], GL_QUERY_RESULT_AVAILABLE, &available);
+    if (!available) {
+        return -1;
+    }
+
+    GLuint64 start;
+    glGetQueryObjectui64v(this->m_queries[slot][0], GL_QUERY_RESULT, &start);
+    for (int i = 0; i < this->m_passes; i++) {
+        GLuint64 end;
+        glGetQueryObjectui64v(this->m_queries[slot][i + 1], GL_QUERY_RESULT, &end);
+        ms[i] = double(end - start) / 1e6;
+        start = end;
+    }
+    this->m_read++;
+    return slot;
+}
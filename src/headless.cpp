@@ -0,0 +1,88 @@
+#include "headless.h"
+
+#include <stdio.h>
+
+#ifdef HAVE_EGL
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#endif
+
+HeadlessContext::HeadlessContext() {
+    this->m_display = NULL;
+    this->m_context = NULL;
+}
+
+#ifdef HAVE_EGL
+
+HeadlessContext::~HeadlessContext() {
+    if (this->m_context) {
+        eglMakeCurrent(this->m_display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+        eglDestroyContext(this->m_display, this->m_context);
+    }
+    if (this->m_display) {
+        eglTerminate(this->m_display);
+    }
+}
+
+int HeadlessContext::create(int major, int minor) {
+    // Prefer the surfaceless platform, the default display may want X
+    EGLDisplay display = EGL_NO_DISPLAY;
+    PFNEGLGETPLATFORMDISPLAYEXTPROC get_platform_display =
+        (PFNEGLGETPLATFORMDISPLAYEXTPROC) eglGetProcAddress("eglGetPlatformDisplayEXT");
+    if (get_platform_display) {
+        display = get_platform_display(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+    }
+    if (display == EGL_NO_DISPLAY) {
+        display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+    }
+
+    EGLint egl_major, egl_minor;
+    if (display == EGL_NO_DISPLAY || !eglInitialize(display, &egl_major, &egl_minor)) {
+        fprintf(stderr, "ERROR: Failed to initialize EGL (0x%x)\n", eglGetError());
+        return -1;
+    }
+    this->m_display = display;
+
+    if (!eglBindAPI(EGL_OPENGL_API)) {
+        fprintf(stderr, "ERROR: EGL has no desktop OpenGL (0x%x)\n", eglGetError());
+        return -1;
+    }
+
+    // Nothing is ever drawn to a surface, so no config is needed either. The
+    // profile matches GLFW's default window context, SOIL still reads the
+    // extension string that core profiles no longer have.
+    const EGLint attributes[] = {
+        EGL_CONTEXT_MAJOR_VERSION, major,
+        EGL_CONTEXT_MINOR_VERSION, minor,
+        EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_COMPATIBILITY_PROFILE_BIT,
+        EGL_NONE
+    };
+    EGLContext context = eglCreateContext(display, EGL_NO_CONFIG_KHR, EGL_NO_CONTEXT, attributes);
+    if (context == EGL_NO_CONTEXT) {
+        fprintf(stderr, "ERROR: Failed to create an OpenGL %d.%d context (0x%x)\n", major, minor, eglGetError());
+        return -1;
+    }
+    this->m_context = context;
+
+    if (!eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context)) {
+        fprintf(stderr, "ERROR: Failed to make the context current (0x%x)\n", eglGetError());
+        return -1;
+    }
+
+    printf("[EGL] - EGL %d.%d from %s\n", egl_major, egl_minor, eglQueryString(display, EGL_VENDOR));
+    return 0;
+}
+
+#else
+
+HeadlessContext::~HeadlessContext() {
+}
+
+int HeadlessContext::create(int major, int minor) {
+    (void) major;
+    (void) minor;
+    fprintf(stderr, "ERROR: Built without EGL, headless rendering is not available\n");
+    return -1;
+}
+
+#endif
@@ -0,0 +1,223 @@
+#include "image.h"
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <SOIL.h>
+
+Image::Image() {
+    this->width = 0;
+    this->height = 0;
+}
+
+Image::Image(int width, int height) {
+    this->width = width;
+    this->height = height;
+    this->pixels.assign((size_t) width * height * 3, 0.0f);
+}
+
+vec3 Image::get(int x, int y) const {
+    const float* p = &this->pixels[((size_t) y * this->width + x) * 3];
+    return vec3(p[0], p[1], p[2]);
+}
+
+void Image::set(int x, int y, const vec3 &c) {
+    float* p = &this->pixels[((size_t) y * this->width + x) * 3];
+    p[0] = c[0];
+    p[1] = c[1];
+    p[2] = c[2];
+}
+
+static const char* extension(const char* file) {
+    const char* dot = strrchr(file, '.');
+    return dot ? dot + 1 : "";
+}
+
+int Image::save(const char* file) const {
+    const char* ext = extension(file);
+
+    // Linear float image, stored bottom row first
+    if (!strcmp(ext, "pfm") || !strcmp(ext, "PFM")) {
+        FILE* f = fopen(file, "wb");
+        if (!f) {
+            fprintf(stderr, "ERROR: Unable to open %s for writing!\n", file);
+            return -1;
+        }
+        fprintf(f, "PF\n%d %d\n-1.0\n", this->width, this->height);
+        for (int y = this->height - 1; y >= 0; y--) {
+            fwrite(&this->pixels[(size_t) y * this->width * 3], sizeof(float), (size_t) this->width * 3, f);
+        }
+        fclose(f);
+        return 0;
+    }
+
+    int type;
+    if (!strcmp(ext, "bmp") || !strcmp(ext, "BMP")) {
+        type = SOIL_SAVE_TYPE_BMP;
+    } else if (!strcmp(ext, "tga") || !strcmp(ext, "TGA")) {
+        type = SOIL_SAVE_TYPE_TGA;
+    } else if (!strcmp(ext, "dds") || !strcmp(ext, "DDS")) {
+        type = SOIL_SAVE_TYPE_DDS;
+    } else {
+        fprintf(stderr, "ERROR: Unsupported image format \"%s\"!\n", ext);
+        return -1;
+    }
+
+    // Gamma correct and quantize
+    std::vector<unsigned char> bytes(this->pixels.size());
+    for (size_t i = 0; i < this->pixels.size(); i++) {
+        float c = sqrtf(fmaxf(this->pixels[i], 0.0f));
+        bytes[i] = (unsigned char) (fminf(c, 1.0f) * 255.0f + 0.5f);
+    }
+
+    if (!SOIL_save_image(file, type, this->width, this->height, 3, bytes.data())) {
+        fprintf(stderr, "ERROR: Failed to save %s: %s\n", file, SOIL_last_result());
+        return -1;
+    }
+    return 0;
+}
+
+int Image::load(const char* file) {
+    FILE* f = fopen(file, "rb");
+    if (!f) {
+        fprintf(stderr, "ERROR: Unable to open %s!\n", file);
+        return -1;
+    }
+
+    int w, h;
+    float scale;
+    if (fscanf(f, "PF %d %d %f", &w, &h, &scale) != 3 || w <= 0 || h <= 0) {
+        fprintf(stderr, "ERROR: %s is not an RGB .pfm image!\n", file);
+        fclose(f);
+        return -1;
+    }
+    fgetc(f);
+
+    this->width = w;
+    this->height = h;
+    this->pixels.assign((size_t) w * h * 3, 0.0f);
+    for (int y = h - 1; y >= 0; y--) {
+        size_t n = (size_t) w * 3;
+        if (fread(&this->pixels[(size_t) y * n], sizeof(float), n, f) != n) {
+            fprintf(stderr, "ERROR: %s is truncated!\n", file);
+            fclose(f);
+            return -1;
+        }
+    }
+    fclose(f);
+
+    // Big endian data
+    if (scale > 0.0f) {
+        for (float &p : this->pixels) {
+            uint32_t u;
+            memcpy(&u, &p, sizeof(u));
+            u = (u >> 24) | ((u >> 8) & 0xff00) | ((u << 8) & 0xff0000) | (u << 24);
+            memcpy(&p, &u, sizeof(u));
+        }
+    }
+    return 0;
+}
+
+double Image::rmse(const Image &reference) const {
+    if (this->width != reference.width || this->height != reference.height) {
+        return -1.0;
+    }
+
+    double sum = 0.0;
+    for (size_t i = 0; i < this->pixels.size(); i++) {
+        double d = double(this->pixels[i]) - double(reference.pixels[i]);
+        sum += d * d;
+    }
+    return sqrt(sum / double(this->pixels.size()));
+}
+
+double Image::relative_mse(const Image &reference) const {
+    if (this->width != reference.width || this->height != reference.height) {
+        return -1.0;
+    }
+
+    double sum = 0.0;
+    for (size_t i = 0; i < this->pixels.size(); i++) {
+        double r = double(reference.pixels[i]);
+        double d = double(this->pixels[i]) - r;
+        sum += d * d / (r * r + 0.01);
+    }
+    return sum / double(this->pixels.size());
+}
+
+// Luminance after the display's gamma, clamped to [0, 1]
+static std::vector<double> display_luminance(const Image &image) {
+    std::vector<double> l((size_t) image.width * image.height);
+    for (size_t i = 0; i < l.size(); i++) {
+        const float* p = &image.pixels[i * 3];
+        double y = 0.2126 * p[0] + 0.7152 * p[1] + 0.0722 * p[2];
+        l[i] = fmin(sqrt(fmax(y, 0.0)), 1.0);
+    }
+    return l;
+}
+
+double Image::ssim(const Image &reference) const {
+    if (this->width != reference.width || this->height != reference.height) {
+        return -2.0;
+    }
+
+    // Constants of the original SSIM paper for a dynamic range of 1
+    const int radius = 5;
+    const double c1 = 0.01 * 0.01;
+    const double c2 = 0.03 * 0.03;
+    double weights[2 * radius + 1];
+    for (int i = -radius; i <= radius; i++) {
+        weights[i + radius] = exp(-double(i * i) / (2.0 * 1.5 * 1.5));
+    }
+
+    std::vector<double> a = display_luminance(*this);
+    std::vector<double> b = display_luminance(reference);
+    int w = this->width;
+    int h = this->height;
+
+    // Windows are cut off at the border and renormalized
+    double sum = 0.0;
+    for (int y = 0; y < h; y++) {
+        for (int x = 0; x < w; x++) {
+            double total = 0.0, ma = 0.0, mb = 0.0, aa = 0.0, bb = 0.0, ab = 0.0;
+            for (int j = -radius; j <= radius; j++) {
+                int v = y + j;
+                if (v < 0 || v >= h) {
+                    continue;
+                }
+                for (int i = -radius; i <= radius; i++) {
+                    int u = x + i;
+                    if (u < 0 || u >= w) {
+                        continue;
+                    }
+                    double k = weights[i + radius] * weights[j + radius];
+                    double pa = a[(size_t) v * w + u];
+                    double pb = b[(size_t) v * w + u];
+                    total += k;
+                    ma += k * pa;
+                    mb += k * pb;
+                    aa += k * pa * pa;
+                    bb += k * pb * pb;
+                    ab += k * pa * pb;
+                }
+            }
+            ma /= total;
+            mb /= total;
+            double va = aa / total - ma * ma;
+            double vb = bb / total - mb * mb;
+            double cov = ab / total - ma * mb;
+            sum += ((2.0 * ma * mb + c1) * (2.0 * cov + c2)) / ((ma * ma + mb * mb + c1) * (va + vb + c2));
+        }
+    }
+    return sum / (double(w) * double(h));
+}
+
+double Image::mean() const {
+    double sum = 0.0;
+    for (float p : this->pixels) {
+        sum += p;
+    }
+    return this->pixels.empty() ? 0.0 : sum / double(this->pixels.size());
+}
@@ -4,11 +4,15 @@
  * @date    2020-04-25
  */
 
+#include <algorithm>
+#include <cmath>
 #include <cstdlib>
+#include <cstring>
 #include <ctime>
 #include <iostream>
+#include <string>
 #include <chrono>
-#include <thread>
+#include <vector>
 
 #if defined(_WIN32) || defined(_WIN64)
 #include <windows.h>
@@ -20,20 +24,164 @@
 
 #include <GLFW/glfw3.h>
 
+#include "buffer.h"
 #include "camera.h"
+#include "cpu_tracer.h"
+#include "gpu_timer.h"
+#include "headless.h"
+#include "image.h"
+#include "readback.h"
+#include "scene.h"
 #include "shader.h"
+#include "sobol.h"
 
 #define FPS_CAP 60.0f
 
-// Window
+// Window, or none when rendering headless
 GLFWwindow *window;
+bool headless = false;
 int w_width  = 1024;
 int w_height = 512;
 
+// Scrambling seed of the sample sequences, random unless --seed is given
+int render_seed = -1;
+
+// Presentation, accumulation runs as many dispatches as fit between two
+// presents: synced to the display, after every dispatch or at a fixed rate
+enum PresentMode { PRESENT_VSYNC, PRESENT_UNCAPPED, PRESENT_FIXED };
+PresentMode present_mode = PRESENT_FIXED;
+double present_rate = FPS_CAP;
+
+// Compile time specializations of the tracing kernels to the scene and
+// settings, see tracer.glsl
+enum Specialization {
+    SPECIALIZE_DEPTH = 1,
+    SPECIALIZE_MATERIALS = 2,
+    SPECIALIZE_RESOLUTION = 4,
+    SPECIALIZE_ALL = 7
+};
+int specialization = SPECIALIZE_ALL;
+
 // Materials
 Camera* c_camera;
-Shader s_quad, s_compute;
-Texture t_gather, t_render, t_mercury;
+Shader s_quad, s_compute, s_compact, s_persistent;
+Shader s_generate, s_extend, s_sort, s_shade, s_accumulate;
+Texture t_gather, t_render, t_moment;
+std::vector<Texture*> t_images;
+Buffer b_nodes, b_prims;
+Buffer b_textures, b_materials, b_spheres, b_rects;
+Buffer b_positions, b_normals, b_uvs, b_triangles;
+Buffer b_instances, b_lights;
+
+// Path length histogram, the GPU's 32 bit counters are drained into here,
+// followed by the rays traced and how paths ended (see tracer.glsl)
+#define RAY_STATS 5
+#define RAY_STATS_OFFSET (PATH_HISTOGRAM * sizeof(uint32_t))
+const char* ray_stat_names[RAY_STATS] = { "primary", "bounce", "shadow", "escaped", "absorbed" };
+enum RayStat { RAY_PRIMARY, RAY_BOUNCE, RAY_SHADOW, PATH_ESCAPED, PATH_ABSORBED };
+Buffer b_path_lengths;
+uint64_t path_lengths[PATH_HISTOGRAM];
+uint64_t ray_totals[RAY_STATS];
+
+// Pixels still being sampled, a { groups x, y, z, count, error sum, pad }
+// header followed by the pixel indices, rebuilt by s_compact every frame.
+// The kernels dispatched over the list run a group per PIXEL_GROUP pixels.
+Buffer b_pixels;
+
+#define LIST_HEADER 32
+#define PIXEL_GROUP 64
+
+// Batch rendering, stops once any condition that is set (non-zero) is met
+// and saves the image
+int batch_spp = 0;
+double batch_time = 0.0;
+float batch_rmse = 0.0f;
+float last_rmse = 1.0f;
+
+// Images are read back and saved without stalling the GPU, with --snapshot
+// also every this many frames while rendering
+Readback readback;
+int snapshot_every = 0;
+
+// Direction numbers of the Sobol sequence the shader samples from
+Buffer b_sobol(GL_UNIFORM_BUFFER);
+
+// The frame_params uniform block of tracer.glsl in std140 layout, shared by
+// every tracing kernel and written before the next frame when it changed
+#define FRAME_PARAMS_BINDING 1
+struct FrameParams {
+    CameraBlock cam;
+    int32_t i_seed;
+    int32_t samples;
+    int32_t depth;
+    int32_t rr_depth;
+    float width;
+    float height;
+    float padding[2];
+};
+FrameParams frame_params;
+bool frame_params_dirty = false;
+Buffer b_frame_params(GL_UNIFORM_BUFFER);
+
+// Wavefront pipeline, a path per pixel and the ray and hit queues between
+// its kernels (see wavefront.glsl)
+bool wavefront = false;
+bool sort_materials = false;
+Buffer b_paths, b_queues;
+
+// Persistent threads, the number of resident groups (0 when off), the most
+// samples an invocation takes per dispatch and their work counter and
+// per-pixel sums (see persistent.comp). llvmpipe ends every loop of an
+// invocation after 65535 iterations in total, so it gets short dispatches.
+#define LLVMPIPE_ITEMS 16
+#define WORK_HEADER 16
+#define WORK_STRIDE 5
+#define WORK_SIZE (WORK_HEADER + sizeof(uint32_t) * WORK_STRIDE * size_t(w_width) * size_t(w_height))
+int persistent_groups = 0;
+int persistent_items = 0;
+Buffer b_work;
+
+// Frames to time before exiting, 0 to keep rendering until the window closes
+int bench_frames = 0;
+
+// GPU timing of every frame's passes, read back a few frames late so the
+// queries never stall. The pixels each frame traced, their error sum and
+// the frame's ray stats are copied aside with it, one buffer per slot so
+// reading one never waits on a newer frame.
+enum Pass { PASS_COMPACT, PASS_TRACE, PASS_BARRIER, PASS_BLIT, PASS_COUNT };
+const char* pass_names[PASS_COUNT] = { "compact", "trace", "barrier", "blit" };
+GpuTimer gpu_timer;
+Buffer b_frame_stats[TIMER_FRAMES];
+int timed_samples[TIMER_FRAMES];
+
+// Per-frame timings are also written here as CSV with --timing-log
+const char* timing_file = NULL;
+FILE* timing_log = NULL;
+
+// Timings gathered since the last report
+struct TimingStats {
+    int frames;
+    double samples;
+    double gpu_ms;
+    double sum[PASS_COUNT];
+    double min[PASS_COUNT];
+    double max[PASS_COUNT];
+};
+TimingStats timing_stats;
+uint64_t timed_frames = 0;
+
+// Ray stats of the frames read back since the last FPS line
+uint64_t window_rays[RAY_STATS];
+
+#define PATH_SIZE 128
+#define RAY_QUEUE 0
+#define HIT_QUEUE 16
+#define SORT_STATS 64
+#define QUEUE_HEADER 80
+#define QUEUE_BARRIER (GL_SHADER_STORAGE_BARRIER_BIT | GL_COMMAND_BARRIER_BIT | GL_BUFFER_UPDATE_BARRIER_BIT)
+
+// Scene
+Scene scene;
 
 // Callbacks
 void glfwError(int code, const char *desc) {
@@ -41,7 +189,57 @@ void glfwError(int code, const char *desc) {
     exit( 2 );
 }
 
-void init(int samples, int depth) {
+void set_frame_params(int seed, int samples, int depth, int rr_depth) {
+    c_camera->write_block(frame_params.cam);
+    frame_params.i_seed = seed;
+    frame_params.samples = samples;
+    frame_params.depth = depth;
+    frame_params.rr_depth = rr_depth;
+    frame_params.width = (float) w_width;
+    frame_params.height = (float) w_height;
+    b_frame_params.upload(&frame_params, sizeof(frame_params), GL_DYNAMIC_DRAW);
+    b_frame_params.bind(FRAME_PARAMS_BINDING);
+}
+
+// Defines what the enabled specializations fix for a tracing kernel before
+// it is compiled: the depth, the material, primitive and texture types the
+// scene uses, and the resolution
+void specialize(Shader &shader, int depth) {
+    if (specialization & SPECIALIZE_DEPTH) {
+        shader.define("MAX_DEPTH", depth);
+    }
+    if (specialization & SPECIALIZE_MATERIALS) {
+        int materials = 0, textures = 0, primitives = 0;
+        for (const Material &m : scene.materials) {
+            materials |= 1 << m.type;
+        }
+        for (const TextureDesc &t : scene.textures) {
+            textures |= 1 << t.type;
+        }
+        primitives |= scene.spheres.empty() ? 0 : 1 << PRIM_SPHERE;
+        primitives |= scene.rects.empty() ? 0 : 1 << PRIM_RECT;
+        primitives |= scene.triangles.empty() ? 0 : 1 << PRIM_TRIANGLE;
+        shader.define("MATERIAL_MASK", materials);
+        shader.define("TEXTURE_MASK", textures);
+        shader.define("PRIMITIVE_MASK", primitives);
+    }
+    if (specialization & SPECIALIZE_RESOLUTION) {
+        shader.define("IMAGE_WIDTH", w_width);
+        shader.define("IMAGE_HEIGHT", w_height);
+    }
+}
+
+// Loads, specializes and compiles a tracing kernel
+void build_kernel(Shader &shader, const char* file, int depth) {
+    shader = Shader();
+    shader.load_file(COMPUTE, file);
+    shader.define("PIXEL_GROUP", PIXEL_GROUP);
+    shader.define("PERSISTENT_ITEMS", persistent_items);
+    specialize(shader, depth);
+    shader.compile();
+}
+
+void init(int samples, int depth, int rr_depth, float adaptive, int min_samples) {
 
     // Texture
     t_render = Texture();
@@ -50,33 +248,130 @@ void init(int samples, int depth) {
     glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, w_width, w_height, 0, GL_RGBA, GL_FLOAT, NULL);
     glBindImageTexture(0, t_render.m_texture, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA8);
 
+    // Accumulators start at zero, the sample count in alpha drives the average
+    std::vector<float> cleared(size_t(w_width) * size_t(w_height) * 4, 0.0f);
     t_gather = Texture();
     t_gather.set_sampling(GL_REPEAT, GL_LINEAR);
     t_gather.bind(1);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, w_width, w_height, 0, GL_RGBA, GL_FLOAT, NULL);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, w_width, w_height, 0, GL_RGBA, GL_FLOAT, cleared.data());
     glBindImageTexture(1, t_gather.m_texture, 0, GL_FALSE, 0, GL_READ_WRITE, GL_RGBA32F);
 
-    t_mercury = Texture();
-    t_mercury.bind(2);
-    t_mercury.load("earth.jpg");
+    // Sum of squared sample luminance, for the per-pixel variance
+    t_moment = Texture();
+    t_moment.set_sampling(GL_REPEAT, GL_NEAREST);
+    t_moment.bind(2);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_R32F, w_width, w_height, 0, GL_RED, GL_FLOAT, cleared.data());
+    glBindImageTexture(2, t_moment.m_texture, 0, GL_FALSE, 0, GL_READ_WRITE, GL_R32F);
+
+    for (size_t i = 0; i < scene.images.size(); i++) {
+        Texture* image = new Texture();
+        image->load(scene.images[i].c_str());
+        t_images.push_back(image);
+    }
+
+    // Scene data, copied straight from the scene's arrays into mapped buffers
+    auto upload_start = std::chrono::steady_clock::now();
+    b_nodes.storage(scene.nodes.data, scene.nodes.bytes());
+    b_nodes.bind(0);
+    b_prims.storage(scene.prims.data, scene.prims.bytes());
+    b_prims.bind(1);
+    b_textures.storage(scene.textures.data, scene.textures.bytes());
+    b_textures.bind(2);
+    b_materials.storage(scene.materials.data, scene.materials.bytes());
+    b_materials.bind(3);
+    b_spheres.storage(scene.spheres.data, scene.spheres.bytes());
+    b_spheres.bind(4);
+    b_rects.storage(scene.rects.data, scene.rects.bytes());
+    b_rects.bind(5);
+    b_positions.storage(scene.positions.data, scene.positions.bytes());
+    b_positions.bind(6);
+    b_normals.storage(scene.normals.data, scene.normals.bytes());
+    b_normals.bind(7);
+    b_uvs.storage(scene.uvs.data, scene.uvs.bytes());
+    b_uvs.bind(8);
+    b_triangles.storage(scene.triangles.data, scene.triangles.bytes());
+    b_triangles.bind(9);
+    b_instances.storage(scene.instances.data, scene.instances.bytes());
+    b_instances.bind(10);
+    b_lights.storage(scene.lights.data, scene.lights.bytes());
+    b_lights.bind(11);
+    uint32_t zeros[PATH_HISTOGRAM + RAY_STATS] = { 0 };
+    b_path_lengths.upload(zeros, sizeof(zeros), GL_DYNAMIC_READ);
+    b_path_lengths.bind(12);
+    b_pixels.upload(NULL, LIST_HEADER + sizeof(uint32_t) * size_t(w_width) * size_t(w_height), GL_DYNAMIC_COPY);
+    b_pixels.bind(13);
+    uint32_t directions[SOBOL_DIMENSIONS * SOBOL_BITS];
+    sobol_directions(directions);
+    b_sobol.storage(directions, sizeof(directions));
+    b_sobol.bind(0);
+    if (persistent_groups > 0) {
+        b_work.upload(NULL, WORK_SIZE, GL_DYNAMIC_COPY);
+        b_work.zero(WORK_SIZE);
+        b_work.bind(14);
+    }
+    if (wavefront) {
+        size_t pixels = size_t(w_width) * size_t(w_height);
+        b_paths.upload(NULL, PATH_SIZE * pixels, GL_DYNAMIC_COPY);
+        b_paths.bind(15);
+        b_queues.upload(NULL, QUEUE_HEADER + sizeof(uint32_t) * 3 * pixels, GL_DYNAMIC_COPY);
+        const uint32_t zeros[4] = { 0 };
+        b_queues.write(zeros, sizeof(zeros), SORT_STATS);
+        b_queues.bind(16);
+    }
+    std::chrono::duration<double, std::milli> upload_time = std::chrono::steady_clock::now() - upload_start;
+    std::cerr << "Scene: uploaded " << scene.nodes.size() << " BVH nodes, " << scene.prims.size()
+              << " primitive references and " << scene.instances.size() << " instances in "
+              << upload_time.count() << " ms" << std::endl;
 
     // Camera
     float aspect = float(w_width) / float(w_height);
-    vec3 target = vec3(278, 278, 0);
-    vec3 pos = vec3(278, 278, -800);
-    float focus = 10.0f;
-    c_camera = new Camera(pos, target, vec3(0, 1, 0), 40.0f, aspect, 0.0f, focus);
+    const CameraDesc &cam = scene.camera;
+    c_camera = new Camera(cam.position, cam.lookat, cam.up, cam.fov, aspect, cam.aperture, cam.focus);
+
+    // Quad rendering, only needed with a window
+    auto shader_start = std::chrono::steady_clock::now();
+    if (!headless) {
+        s_quad = Shader();
+        s_quad.load_file(VERTEX, "quad.vert");
+        s_quad.load_file(FRAGMENT, "quad.frag");
+        s_quad.compile();
+    }
 
-    // Quad rendering
-    s_quad = Shader();
-    s_quad.load_file(VERTEX, "quad.vert");
-    s_quad.load_file(FRAGMENT, "quad.frag");
-    s_quad.compile();
+    // Enough samples per invocation to take a frame's budget in one dispatch
+    if (persistent_groups > 0) {
+        size_t budget = size_t(w_width) * size_t(w_height) * size_t(samples);
+        size_t invocations = size_t(persistent_groups) * PIXEL_GROUP;
+        persistent_items = (int) std::max<size_t>((budget + invocations - 1) / invocations, 1);
+        const char* renderer = (const char*) glGetString(GL_RENDERER);
+        if (renderer && strstr(renderer, "llvmpipe")) {
+            persistent_items = std::min(persistent_items, LLVMPIPE_ITEMS);
+        }
+    }
 
     // Compute shader
-    s_compute = Shader();
-    s_compute.load_file(COMPUTE, "raytracer.comp");
-    s_compute.compile();
+    build_kernel(s_compute, "raytracer.comp", depth);
+    if (persistent_groups > 0) {
+        build_kernel(s_persistent, "persistent.comp", depth);
+    }
+    if (wavefront) {
+        build_kernel(s_generate, "generate.comp", depth);
+        build_kernel(s_extend, "extend.comp", depth);
+        build_kernel(s_sort, "sort.comp", depth);
+        build_kernel(s_shade, "shade.comp", depth);
+        build_kernel(s_accumulate, "accumulate.comp", depth);
+    }
+    build_kernel(s_compact, "compact.comp", depth);
+
+    Shader* programs[] = { &s_quad, &s_compute, &s_compact, &s_persistent, &s_generate,
+                           &s_extend, &s_sort, &s_shade, &s_accumulate };
+    int built = 0, cached = 0;
+    for (Shader* program : programs) {
+        built += program->program ? 1 : 0;
+        cached += program->cached ? 1 : 0;
+    }
+    std::chrono::duration<double, std::milli> shader_time = std::chrono::steady_clock::now() - shader_start;
+    std::cerr << "Shaders: built " << built << " programs, " << cached << " from the cache, in "
+              << shader_time.count() << " ms" << std::endl;
 
     // Configure shaders
     srand(time(NULL));
@@ -86,16 +381,39 @@ void init(int samples, int depth) {
     s_compute.uniform_int("dest", 0);
     t_render.bind(1);
     s_compute.uniform_int("src", 1);
-    t_mercury.bind(2);
-    s_compute.uniform_int("mercury_tex", 2);
+    for (size_t i = 0; i < t_images.size(); i++) {
+        t_images[i]->bind(2 + i);
+    }
+
+    // Scrambles the sample sequences, fixed so later frames continue them
+    int seed = render_seed >= 0 ? render_seed : rand();
+    set_frame_params(seed, samples, depth, rr_depth);
+    for (Shader* program : programs) {
+        if (program->program) {
+            program->bind_ubo("frame_params", FRAME_PARAMS_BINDING);
+        }
+    }
+    if (wavefront) {
+        s_shade.bind();
+        s_shade.uniform_int("sorted", sort_materials);
+    }
 
-    s_compute.uniform_int("i_seed", rand());
-    s_compute.uniform_int("samples", samples);
-    s_compute.uniform_int("depth", depth);
-    s_compute.uniform_float("width", (float) w_width);
-    s_compute.uniform_float("height", (float) w_height);
-    c_camera->update_shader(s_compute);
+    s_compact.bind();
+    s_compact.uniform_float("threshold", adaptive);
+    s_compact.uniform_int("min_samples", min_samples);
 
+    readback.create(w_width, w_height);
+
+    // Frame timing, the tracer still runs without it
+    if (!gpu_timer.create(PASS_COUNT)) {
+        for (int i = 0; i < TIMER_FRAMES; i++) {
+            b_frame_stats[i].upload(NULL, sizeof(uint32_t) * (2 + RAY_STATS), GL_STREAM_READ);
+        }
+    }
+
+    if (headless) {
+        return;
+    }
 
     s_quad.bind();
     s_quad.uniform_int("render_tex", 0);
@@ -121,28 +439,349 @@ void init(int samples, int depth) {
     glEnableVertexAttribArray(posPtr);
 }
 
-void render(int n) {
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+// Empty queue header, also the indirect dispatch arguments of no groups
+const uint32_t empty_queue[4] = { 0, 1, 1, 0 };
 
-    // Compute Shader
-    s_compute.bind();
+// Empty pixel list with no error summed yet
+const uint32_t empty_list[LIST_HEADER / 4] = { 0, 1, 1, 0 };
+
+// Empty hit queue followed by empty material bins
+const uint32_t empty_hits[12] = { 0, 1, 1, 0 };
+
+void dispatch_indirect(Shader &shader, Buffer &args, size_t offset) {
+    shader.bind();
+    glBindBuffer(GL_DISPATCH_INDIRECT_BUFFER, args.m_buffer);
+    glDispatchComputeIndirect(offset);
+    glBindBuffer(GL_DISPATCH_INDIRECT_BUFFER, 0);
+}
+
+// Every sample of every bounce, one kernel per pass. The host never waits
+// for the queue sizes, empty queues dispatch no groups.
+void trace_wavefront(int samples, int depth) {
+    for (int i = 0; i < samples; i++) {
+        b_queues.write(empty_queue, sizeof(empty_queue), RAY_QUEUE);
+        s_generate.bind();
+        s_generate.uniform_int("pass", i);
+        dispatch_indirect(s_generate, b_pixels, 0);
+        glMemoryBarrier(QUEUE_BARRIER);
+
+        for (int j = 0; j < depth; j++) {
+            b_queues.write(empty_hits, sizeof(empty_hits), HIT_QUEUE);
+            dispatch_indirect(s_extend, b_queues, RAY_QUEUE);
+            glMemoryBarrier(QUEUE_BARRIER);
+
+            if (sort_materials) {
+                dispatch_indirect(s_sort, b_queues, HIT_QUEUE);
+                glMemoryBarrier(QUEUE_BARRIER);
+            }
+
+            b_queues.write(empty_queue, sizeof(empty_queue), RAY_QUEUE);
+            dispatch_indirect(s_shade, b_queues, HIT_QUEUE);
+            glMemoryBarrier(QUEUE_BARRIER);
+        }
+    }
+    dispatch_indirect(s_accumulate, b_pixels, 0);
+}
+
+// Every sample of every listed pixel through the persistent groups. The
+// list's length stays on the GPU, so there are enough dispatches for all
+// pixels being listed, groups past the end of the budget return at once.
+void trace_persistent(int samples) {
+    size_t budget = size_t(w_width) * size_t(w_height) * size_t(samples);
+    size_t per_dispatch = size_t(persistent_groups) * PIXEL_GROUP * size_t(persistent_items);
+    size_t dispatches = (budget + per_dispatch - 1) / per_dispatch;
+
+    // Nothing of a previous frame may be left in the counter or the sums
+    b_work.zero(sizeof(uint32_t));
+    b_work.zero(WORK_SIZE - WORK_HEADER, WORK_HEADER);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+    s_persistent.bind();
+    for (size_t i = 0; i < dispatches; i++) {
+        glDispatchCompute(persistent_groups, 1, 1);
+        glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+    }
+}
+
+// Fails if a persistent invocation was ever cut short and left samples out
+// of the image
+int check_persistent() {
+    if (persistent_groups <= 0) {
+        return 0;
+    }
+
+    uint32_t counts[3];
+    glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+    b_work.read(counts, sizeof(counts));
+    if (counts[1] != counts[2]) {
+        fprintf(stderr, "ERROR: Persistent groups took %u samples but only added %u to the image, "
+                        "the driver cut the kernel short\n", counts[1], counts[2]);
+        return -1;
+    }
+    return 0;
+}
+
+// Accumulates a frame and draws the image when it is presented next
+void render(int samples, int depth, bool present) {
+    int slot = gpu_timer.begin();
+
+    // Parameters changed since the last frame, queued ahead of its kernels
+    if (frame_params_dirty) {
+        b_frame_params.write(&frame_params, sizeof(frame_params));
+        frame_params_dirty = false;
+    }
+
+    // Gather the pixels that have not converged yet
+    b_pixels.write(empty_list, sizeof(empty_list));
+    s_compact.bind();
+    glDispatchCompute((w_width + 7) / 8, (w_height + 7) / 8, 1);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_COMMAND_BARRIER_BIT | GL_BUFFER_UPDATE_BARRIER_BIT);
+    gpu_timer.mark();
+
+    // The error comes back with the frame's timings, without them waiting
+    // for the compaction is the only way to get it
+    if (slot < 0 && batch_rmse > 0.0f) {
+        float error_sum;
+        b_pixels.read(&error_sum, sizeof(error_sum), 16);
+        last_rmse = sqrtf(error_sum / float(w_width * w_height));
+    }
+
+    // Compute Shader, one invocation per listed pixel
     t_render.bind(0);
     t_gather.bind(1);
-    s_compute.uniform_int("i_seed", rand());
-    s_compute.uniform_int("n_render", n);
-    glDispatchCompute(w_width / 32, w_height / 32, 1);
+    if (wavefront) {
+        trace_wavefront(samples, depth);
+    } else if (persistent_groups > 0) {
+        trace_persistent(samples);
+    } else {
+        dispatch_indirect(s_compute, b_pixels, 0);
+    }
+    if (slot >= 0) {
+        // The ray stats start over every frame, the clear is queued after
+        // the copy
+        const uint32_t cleared_rays[RAY_STATS] = { 0 };
+        glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+        b_frame_stats[slot].copy(b_pixels, 2 * sizeof(uint32_t), 12);
+        b_frame_stats[slot].copy(b_path_lengths, sizeof(cleared_rays), RAY_STATS_OFFSET, 2 * sizeof(uint32_t));
+        b_path_lengths.write(cleared_rays, sizeof(cleared_rays), RAY_STATS_OFFSET);
+        timed_samples[slot] = samples;
+    }
+    gpu_timer.mark();
 
-    glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+    // The list header is rewritten and read back from the host next
+    glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT | GL_BUFFER_UPDATE_BARRIER_BIT);
+    gpu_timer.mark();
 
-    // Draw to screen
-    s_quad.bind();
-    t_render.bind(0);
-    glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+    // Draw to screen, swapped in by the caller when it is time
+    if (present) {
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        s_quad.bind();
+        t_render.bind(0);
+        glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+    }
+    gpu_timer.mark();
+}
+
+// Changes the samples each tracing kernel takes per pixel and frame, from
+// the next frame on
+void set_samples(int samples) {
+    if (frame_params.samples != samples) {
+        frame_params.samples = samples;
+        frame_params_dirty = true;
+    }
+}
 
-    glfwSwapBuffers(window);
+// Saves the linear average of every pixel gathered so far
+int save_gather(const char* output) {
+    glMemoryBarrier(GL_TEXTURE_UPDATE_BARRIER_BIT);
+
+    // Snapshots still in flight have to free a buffer first
+    if (readback.request(t_gather.m_texture, output)) {
+        readback.finish();
+        readback.request(t_gather.m_texture, output);
+    }
+    return readback.finish();
 }
 
-int gather(int samples, int depth) {
+// Starts saving the image so far next to output, named after its samples
+// per pixel, and logs when it was taken
+void save_snapshot(const char* output, int spp, double seconds) {
+    std::string file = output;
+    size_t dot = file.find_last_of('.');
+    char suffix[16];
+    snprintf(suffix, sizeof(suffix), "_%06d", spp);
+    file.insert(dot == std::string::npos ? file.size() : dot, suffix);
+
+    glMemoryBarrier(GL_TEXTURE_UPDATE_BARRIER_BIT);
+    if (readback.request(t_gather.m_texture, file.c_str())) {
+        printf("[Snapshot] - skipped %s, the previous ones are still being read\n", file.c_str());
+    } else {
+        printf("[Snapshot] - %s at %.3f s\n", file.c_str(), seconds);
+    }
+}
+
+void drain_path_lengths() {
+    uint32_t counts[PATH_HISTOGRAM];
+    glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+    b_path_lengths.read(counts, sizeof(counts));
+    for (int i = 0; i < PATH_HISTOGRAM; i++) {
+        path_lengths[i] += counts[i];
+        counts[i] = 0;
+    }
+    b_path_lengths.write(counts, sizeof(counts));
+}
+
+// Prints how many rays of each kind were traced and how the paths ended
+void print_ray_stats(const uint64_t* rays) {
+    uint64_t paths = rays[PATH_ESCAPED] + rays[PATH_ABSORBED];
+    if (rays[RAY_PRIMARY] == 0) {
+        return;
+    }
+
+    printf("[Rays] - %llu rays, %llu primary, %llu bounce, %llu shadow\n",
+           (unsigned long long) (rays[RAY_PRIMARY] + rays[RAY_BOUNCE] + rays[RAY_SHADOW]),
+           (unsigned long long) rays[RAY_PRIMARY], (unsigned long long) rays[RAY_BOUNCE],
+           (unsigned long long) rays[RAY_SHADOW]);
+    printf("[Rays] - %.2f%% of paths escaped, %.2f%% were absorbed, %.2f%% reached the depth limit\n",
+           100.0 * double(rays[PATH_ESCAPED]) / double(rays[RAY_PRIMARY]),
+           100.0 * double(rays[PATH_ABSORBED]) / double(rays[RAY_PRIMARY]),
+           100.0 * double(rays[RAY_PRIMARY] - std::min(paths, rays[RAY_PRIMARY])) / double(rays[RAY_PRIMARY]));
+}
+
+// Collects the timings of every frame the GPU has finished since the last
+// call, each frame is also written to the timing log. The error of the
+// image before the newest of them becomes last_rmse.
+void drain_timings() {
+    double ms[PASS_COUNT];
+    int slot;
+    while ((slot = gpu_timer.poll(ms)) >= 0) {
+        uint32_t frame[2 + RAY_STATS];
+        b_frame_stats[slot].read(frame, sizeof(frame));
+        uint32_t pixels = frame[0];
+        float error_sum;
+        memcpy(&error_sum, &frame[1], sizeof(error_sum));
+        last_rmse = sqrtf(error_sum / float(w_width * w_height));
+        const uint32_t* frame_rays = frame + 2;
+        double samples = double(pixels) * double(timed_samples[slot]);
+        uint64_t rays = 0;
+        for (int i = 0; i < RAY_STATS; i++) {
+            ray_totals[i] += frame_rays[i];
+            window_rays[i] += frame_rays[i];
+        }
+        for (int i = RAY_PRIMARY; i <= RAY_SHADOW; i++) {
+            rays += frame_rays[i];
+        }
+
+        TimingStats &stats = timing_stats;
+        double total = 0.0;
+        for (int i = 0; i < PASS_COUNT; i++) {
+            stats.sum[i] += ms[i];
+            stats.min[i] = stats.frames ? std::min(stats.min[i], ms[i]) : ms[i];
+            stats.max[i] = stats.frames ? std::max(stats.max[i], ms[i]) : ms[i];
+            total += ms[i];
+        }
+        stats.frames++;
+        stats.samples += samples;
+        stats.gpu_ms += total;
+
+        if (timing_log) {
+            fprintf(timing_log, "%llu,%u,%d,%.0f", (unsigned long long) timed_frames, pixels, timed_samples[slot], samples);
+            for (int i = 0; i < PASS_COUNT; i++) {
+                fprintf(timing_log, ",%.4f", ms[i]);
+            }
+            fprintf(timing_log, ",%.1f", total > 0.0 ? samples / total * 1000.0 : 0.0);
+            for (int i = 0; i < RAY_STATS; i++) {
+                fprintf(timing_log, ",%u", frame_rays[i]);
+            }
+            fprintf(timing_log, ",%.1f\n", total > 0.0 ? double(rays) / total * 1000.0 : 0.0);
+        }
+        timed_frames++;
+    }
+}
+
+// Prints the average, minimum and maximum time of each pass and the sample
+// rate of the frames timed since the last report
+void report_timings() {
+    drain_timings();
+    TimingStats &stats = timing_stats;
+    if (!stats.frames) {
+        return;
+    }
+
+    fprintf(stderr, "[GPU] -");
+    for (int i = 0; i < PASS_COUNT; i++) {
+        fprintf(stderr, " %s %.3f ms (%.3f-%.3f),", pass_names[i],
+                stats.sum[i] / stats.frames, stats.min[i], stats.max[i]);
+    }
+    fprintf(stderr, " %.2f M samples/s over %d frames", stats.samples / stats.gpu_ms / 1000.0, stats.frames);
+    if (gpu_timer.m_dropped) {
+        fprintf(stderr, ", %llu dropped", (unsigned long long) gpu_timer.m_dropped);
+    }
+    fprintf(stderr, "\n");
+    stats = TimingStats();
+}
+
+// Reports how many branches of the material switch the shading groups ran
+void drain_sort_stats() {
+    uint32_t stats[4];
+    glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+    b_queues.read(stats, sizeof(stats), SORT_STATS);
+    if (stats[0] > 0) {
+        double groups = double(stats[0]);
+        if (sort_materials) {
+            printf("[Sort] - %.3f material branches per shading group, %.3f unsorted\n",
+                   double(stats[1]) / groups, double(stats[2]) / groups);
+        } else {
+            printf("[Sort] - %.3f material branches per shading group\n", double(stats[1]) / groups);
+        }
+    }
+
+    const uint32_t zeros[4] = { 0 };
+    b_queues.write(zeros, sizeof(zeros), SORT_STATS);
+}
+
+void print_path_lengths(const uint64_t* lengths) {
+    uint64_t paths = 0;
+    double bounces = 0.0;
+    for (int i = 0; i < PATH_HISTOGRAM; i++) {
+        paths += lengths[i];
+        bounces += double(i) * double(lengths[i]);
+    }
+    if (paths == 0) {
+        return;
+    }
+
+    printf("[Paths] - %llu paths, %.3f bounces on average\n", (unsigned long long) paths, bounces / double(paths));
+    uint64_t reaching = paths;
+    for (int i = 0; i < PATH_HISTOGRAM && reaching > 0; i++) {
+        printf("[Paths] - %6.2f%% reach %2d%s bounces\n", 100.0 * double(reaching) / double(paths), i,
+               i == PATH_HISTOGRAM - 1 ? "+" : "");
+        reaching -= lengths[i];
+    }
+}
+
+// Creates the window and its context, or just a context when headless
+int open_context(HeadlessContext &context) {
+    if (headless) {
+        if (context.create(4, 3)) {
+            return -1;
+        }
+
+        // GLEW also looks for a GLX display, which headless machines lack,
+        // but the GL entry points are loaded by then
+        glewExperimental = GL_TRUE;
+        GLenum err = glewInit();
+#ifdef GLEW_ERROR_NO_GLX_DISPLAY
+        if (err == GLEW_ERROR_NO_GLX_DISPLAY) {
+            err = GLEW_OK;
+        }
+#endif
+        if (err != GLEW_OK) {
+            std::cerr << "GLEW error: " << glewGetErrorString(err) << std::endl;
+            return -1;
+        }
+        std::cerr << "EGL: using " << glGetString(GL_VERSION) << " context on " << glGetString(GL_RENDERER) << std::endl;
+        return 0;
+    }
 
     // Initialize GLFW
     glfwSetErrorCallback( glfwError );
@@ -194,55 +833,348 @@ int gather(int samples, int depth) {
     glDepthFunc(GL_LEQUAL);
     glClearDepth(1.0f);
 
-    init(samples, depth);
+    return 0;
+}
+
+int gather(int samples, int depth, int rr_depth, float adaptive, int min_samples, const char* output) {
 
-    time_t start = time(NULL);
-    time_t last_update = time(NULL);
-    time_t now;
-    double diff;
-    double delta;
-    double last_fps = 0;
+    // Batch renders and benchmarks run as fast as they can, and are the
+    // only kinds a headless context can do
+    bool batch = batch_spp > 0 || batch_time > 0.0 || batch_rmse > 0.0f;
+    if (headless && !batch && bench_frames <= 0) {
+        std::cerr << "Headless rendering needs --spp, --time-limit, --target-rmse or --bench" << std::endl;
+        return 1;
+    }
+
+    HeadlessContext context;
+    if (open_context(context)) {
+        return 1;
+    }
+
+    init(samples, depth, rr_depth, adaptive, min_samples);
+
+    if (timing_file) {
+        timing_log = fopen(timing_file, "w");
+        if (!timing_log) {
+            fprintf(stderr, "ERROR: Failed to open timing log %s\n", timing_file);
+            return 1;
+        }
+        fprintf(timing_log, "frame,pixels,samples_per_pixel,samples");
+        for (int i = 0; i < PASS_COUNT; i++) {
+            fprintf(timing_log, ",%s_ms", pass_names[i]);
+        }
+        fprintf(timing_log, ",samples_per_second");
+        for (int i = 0; i < RAY_STATS; i++) {
+            fprintf(timing_log, ",%s", ray_stat_names[i]);
+        }
+        fprintf(timing_log, ",rays_per_second\n");
+    }
+
+    // Batch renders run as fast as they can too, they only present less
+    double present_period = 1.0 / present_rate;
+    if (!headless) {
+        glfwSwapInterval(present_mode == PRESENT_VSYNC ? 1 : 0);
+        const GLFWvidmode* mode = glfwGetVideoMode(glfwGetPrimaryMonitor());
+        if (present_mode == PRESENT_VSYNC && mode && mode->refreshRate > 0) {
+            present_period = 1.0 / mode->refreshRate;
+        }
+    }
+    auto batch_start = std::chrono::steady_clock::now();
+    int taken = 0;
+
+    auto last_report = std::chrono::steady_clock::now();
+    auto next_present = last_report;
+    double dispatch_time = 0.0;
+    GLsync in_flight = 0;
+    int presents = 0;
+    int dispatches = 0;
     int frames = 0;
-    int n = 0;
-    while( !glfwWindowShouldClose(window) ) {
-        now = time(NULL);
-        diff = difftime(now, last_update);
-        last_update = now;
-        
-        last_fps += diff;
+    while( headless || !glfwWindowShouldClose(window) ) {
+        auto now = std::chrono::steady_clock::now();
+        if (now - last_report >= std::chrono::seconds(1)) {
+            uint32_t header[4];
+            b_pixels.read(header, sizeof(header));
+
+            // Rays of the frames read back this second, a few frames late
+            drain_timings();
+            std::chrono::duration<double> interval = now - last_report;
+            uint64_t rays = window_rays[RAY_PRIMARY] + window_rays[RAY_BOUNCE] + window_rays[RAY_SHADOW];
+            double segments = double(window_rays[RAY_PRIMARY] + window_rays[RAY_BOUNCE]);
+            printf("[FPS] - %d, %d dispatches, %u/%d pixels sampling, %.2f Mrays/s, %.2f rays per path\n",
+                   presents, dispatches, header[3], w_width * w_height, double(rays) / interval.count() / 1e6,
+                   window_rays[RAY_PRIMARY] ? segments / double(window_rays[RAY_PRIMARY]) : 0.0);
+            memset(window_rays, 0, sizeof(window_rays));
+            last_report = now;
+            presents = 0;
+            dispatches = 0;
+            drain_path_lengths();
+            if (wavefront) {
+                drain_sort_stats();
+            }
+            report_timings();
+        }
+
+        // The error is that of a frame or two ago, so the target is
+        // noticed a frame or two late rather than stalling every frame
+        std::chrono::duration<double> elapsed = now - batch_start;
+        if ((batch_spp > 0 && taken >= batch_spp) || (batch_time > 0.0 && elapsed.count() >= batch_time) ||
+            (batch_rmse > 0.0f && last_rmse <= batch_rmse) || (bench_frames > 0 && frames >= bench_frames)) {
+            break;
+        }
+
+        // The last frame only takes the samples still missing
+        int frame_samples = batch_spp > 0 ? std::min(samples, batch_spp - taken) : samples;
+        if (frame_samples != samples) {
+            set_samples(frame_samples);
+        }
+
+        // Present with the first dispatch that finishes after the present
+        // is due, the GPU keeps tracing until then instead of waiting
+        std::chrono::duration<double> until_present = next_present - now;
+        bool present = !headless &&
+            (present_mode == PRESENT_UNCAPPED || until_present.count() < dispatch_time);
+        render(frame_samples, depth, present);
+        taken += frame_samples;
+        dispatches++;
         frames++;
 
-        if (last_fps >= 1.0f) {
-            printf("[FPS] - %d\n", frames);
-            last_fps = 0.0f;
-            frames = 0;
+        // At most two dispatches are queued, so the time between them
+        // follows the GPU and the host never runs far ahead of it
+        GLsync fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        if (in_flight) {
+            while (glClientWaitSync(in_flight, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000) == GL_TIMEOUT_EXPIRED) {
+            }
+            glDeleteSync(in_flight);
+        }
+        in_flight = fence;
+
+        if (snapshot_every > 0 && frames % snapshot_every == 0) {
+            std::chrono::duration<double> snapshot_time = std::chrono::steady_clock::now() - batch_start;
+            save_snapshot(output, taken, snapshot_time.count());
+        }
+        readback.poll();
+        drain_timings();
+
+        std::chrono::duration<double> took = std::chrono::steady_clock::now() - now;
+        dispatch_time = dispatches > 1 ? 0.875 * dispatch_time + 0.125 * took.count() : took.count();
+
+        if (!present) {
+            continue;
         }
-        n++;
-        render(n);
+        glfwSwapBuffers(window);
+        glfwPollEvents();
+        presents++;
 
-        glfwPollEvents(); 
+        // A fixed rate keeps its schedule unless it fell behind, vsync
+        // restarts from the swap that just returned
+        auto presented = std::chrono::steady_clock::now();
+        auto period = std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+            std::chrono::duration<double>(present_period));
+        next_present = present_mode == PRESENT_FIXED ? std::max(next_present + period, presented) : presented + period;
+    }
+    if (in_flight) {
+        glDeleteSync(in_flight);
+    }
 
-        int us = (int) ((difftime(last_update, time(NULL)) + (1.0f / FPS_CAP)) * 1000000);
-        std::this_thread::sleep_for(std::chrono::microseconds(us));
+    if (bench_frames > 0) {
+        glFinish();
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - batch_start;
+        printf("[Bench] - %d frames of %d spp in %.3f s, %.3f ms per frame\n", frames, samples,
+               elapsed.count(), 1000.0 * elapsed.count() / frames);
     }
 
+    int status = readback.finish();
+    status |= check_persistent();
+    if (batch) {
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - batch_start;
+        printf("[Batch] - %d spp in %.3f s", taken, elapsed.count());
+        if (batch_rmse > 0.0f) {
+            printf(", estimated rmse %.5f", last_rmse);
+        }
+        printf("\n");
+
+        status |= save_gather(output);
+        if (!status) {
+            printf("[Batch] - wrote %s\n", output);
+        }
+    }
+
+    // Every frame's timestamps have arrived once the GPU is idle
+    glFinish();
+    report_timings();
+    if (timing_log) {
+        fclose(timing_log);
+    }
+
+    drain_path_lengths();
+    print_path_lengths(path_lengths);
+    print_ray_stats(ray_totals);
+
     delete c_camera;
+    for (Texture* image : t_images) {
+        delete image;
+    }
 
-    glfwDestroyWindow( window );
-    glfwTerminate();
+    if (!headless) {
+        glfwDestroyWindow( window );
+        glfwTerminate();
+    }
+
+    return status ? 1 : 0;
+}
+
+int trace_cpu(int samples, int depth, int rr_depth, int frames, int threads, const char* output) {
+    CpuTracer tracer(scene, w_width, w_height, samples, depth, rr_depth, threads, render_seed);
+    if (tracer.load_textures()) {
+        return 1;
+    }
 
+    std::cerr << "CPU: using " << tracer.thread_count() << " threads" << std::endl;
+
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < frames; i++) {
+        tracer.render(1);
+        printf("[CPU] - frame %d/%d\n", i + 1, frames);
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    double spp = double(w_width) * double(w_height) * double(samples) * double(frames);
+    printf("[CPU] - %.3f s, %.3f Msamples/s\n", elapsed.count(), spp / elapsed.count() / 1e6);
+    print_path_lengths(tracer.path_lengths().data());
+
+    Image image;
+    tracer.resolve(image);
+    if (image.save(output)) {
+        return 1;
+    }
+    printf("[CPU] - wrote %s\n", output);
     return 0;
 }
 
 int main(int argc, char **argv) {
     int samples = 25;
     int depth = 20;
-    if (argc >= 3) {
-        depth = atoi(argv[2]);
+    int rr_depth = 3;
+    float adaptive = 0.0f;
+    int min_samples = 64;
+    bool cpu = false;
+    int frames = 1;
+    int threads = 0;
+    const char* output = "render.bmp";
+    const char* scene_file = "cornell.scene";
+    const char* export_file = NULL;
+
+    int positional = 0;
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--cpu")) {
+            cpu = true;
+        } else if (!strcmp(argv[i], "--rr-depth") && i + 1 < argc) {
+            rr_depth = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--adaptive") && i + 1 < argc) {
+            adaptive = (float) atof(argv[++i]);
+        } else if (!strcmp(argv[i], "--min-samples") && i + 1 < argc) {
+            min_samples = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--size") && i + 1 < argc) {
+            if (sscanf(argv[++i], "%dx%d", &w_width, &w_height) != 2 || w_width <= 0 || w_height <= 0) {
+                std::cerr << "Invalid size: " << argv[i] << ", expected WIDTHxHEIGHT" << std::endl;
+                return 1;
+            }
+        } else if (!strcmp(argv[i], "--seed") && i + 1 < argc) {
+            render_seed = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--snapshot") && i + 1 < argc) {
+            snapshot_every = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--timing-log") && i + 1 < argc) {
+            timing_file = argv[++i];
+        } else if (!strcmp(argv[i], "--present") && i + 1 < argc) {
+            i++;
+            if (!strcmp(argv[i], "vsync")) {
+                present_mode = PRESENT_VSYNC;
+            } else if (!strcmp(argv[i], "uncapped")) {
+                present_mode = PRESENT_UNCAPPED;
+            } else if (atof(argv[i]) > 0.0) {
+                present_mode = PRESENT_FIXED;
+                present_rate = atof(argv[i]);
+            } else {
+                std::cerr << "Unknown present mode: " << argv[i] << std::endl;
+                return 1;
+            }
+        } else if (!strcmp(argv[i], "--specialize") && i + 1 < argc) {
+            specialization = 0;
+            std::string list = argv[++i];
+            size_t start = 0;
+            while (start <= list.size()) {
+                size_t end = std::min(list.find(',', start), list.size());
+                std::string name = list.substr(start, end - start);
+                if (name == "depth") {
+                    specialization |= SPECIALIZE_DEPTH;
+                } else if (name == "materials") {
+                    specialization |= SPECIALIZE_MATERIALS;
+                } else if (name == "resolution") {
+                    specialization |= SPECIALIZE_RESOLUTION;
+                } else if (name == "all") {
+                    specialization |= SPECIALIZE_ALL;
+                } else if (name != "none") {
+                    std::cerr << "Unknown specialization: " << name << std::endl;
+                    return 1;
+                }
+                start = end + 1;
+            }
+        } else if (!strcmp(argv[i], "--shader-cache") && i + 1 < argc) {
+            Shader::set_cache_dir(argv[++i]);
+        } else if (!strcmp(argv[i], "--no-shader-cache")) {
+            Shader::set_cache_dir(NULL);
+        } else if (!strcmp(argv[i], "--headless")) {
+            headless = true;
+        } else if (!strcmp(argv[i], "--wavefront")) {
+            wavefront = true;
+        } else if (!strcmp(argv[i], "--persistent") && i + 1 < argc) {
+            persistent_groups = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--bench") && i + 1 < argc) {
+            bench_frames = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--sort-materials")) {
+            wavefront = true;
+            sort_materials = true;
+        } else if (!strcmp(argv[i], "--spp") && i + 1 < argc) {
+            batch_spp = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--time-limit") && i + 1 < argc) {
+            batch_time = atof(argv[++i]);
+        } else if (!strcmp(argv[i], "--target-rmse") && i + 1 < argc) {
+            batch_rmse = (float) atof(argv[++i]);
+        } else if (!strcmp(argv[i], "--frames") && i + 1 < argc) {
+            frames = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--threads") && i + 1 < argc) {
+            threads = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--output") && i + 1 < argc) {
+            output = argv[++i];
+        } else if (!strcmp(argv[i], "--scene") && i + 1 < argc) {
+            scene_file = argv[++i];
+        } else if (!strcmp(argv[i], "--export") && i + 1 < argc) {
+            export_file = argv[++i];
+        } else if (positional == 0) {
+            samples = atoi(argv[i]);
+            positional++;
+        } else if (positional == 1) {
+            depth = atoi(argv[i]);
+            positional++;
+        } else {
+            std::cerr << "Unknown argument: " << argv[i] << std::endl;
+            return 1;
+        }
     }
-    if (argc >= 2) {
-        samples = atoi(argv[1]);
+
+    auto load_start = std::chrono::steady_clock::now();
+    if (scene.load(scene_file)) {
+        return 1;
     }
+    std::chrono::duration<double, std::milli> load_time = std::chrono::steady_clock::now() - load_start;
+    std::cerr << "Scene: loaded " << scene_file << " in " << load_time.count() << " ms" << std::endl;
 
-    return gather(samples, depth);
+    if (export_file) {
+        return scene.save_binary(export_file) ? 1 : 0;
+    }
+
+    if (cpu) {
+        return trace_cpu(samples, depth, rr_depth, frames, threads, output);
+    }
+    return gather(samples, depth, rr_depth, adaptive, min_samples, output);
 }
@@ -1,102 +1,178 @@
-// #include "matrix.h"
-
-
-// void mat4_identity(mat4 mat) {
-//     memset(mat, 0, 16 * sizeof(float));
-//     mat[INDEX(0, 0)] = 1.0f;
-//     mat[INDEX(1, 1)] = 1.0f;
-//     mat[INDEX(2, 2)] = 1.0f;
-//     mat[INDEX(3, 3)] = 1.0f;
-// }
-
-// void mat4_perspective(mat4 mat, float fov, float near, float far, float aspect) {
-//     float r = tanf(fov * 0.5f * 3.1415926535f / 180.0f);
-
-//     memset(mat, 0, 16 * sizeof(float));
-//     mat[INDEX(0, 0)] = 1.0f / (r * aspect);
-//     mat[INDEX(1, 1)] = 1.0f / r;
-//     mat[INDEX(2, 2)] = -(far + near) / (far - near);
-//     mat[INDEX(3, 2)] = (-2.0f * far * near) / (far - near);
-//     mat[INDEX(2, 3)] = -1.0f;
-// }
-
-// void mat4_orthographic(mat4 mat, float left, float right, float bottom, float top, float near, float far) {
-//     memset(mat, 0, 16 * sizeof(float));
-//     mat[INDEX(0, 0)] = 2.0f / (right - left);
-//     mat[INDEX(1, 1)] = 2.0f / (top - bottom);
-//     mat[INDEX(2, 2)] = -2.0f / (far - near);
-//     mat[INDEX(3, 0)] = -(right + left) / (right - left);
-//     mat[INDEX(3, 0)] = -(top + bottom) / (top - bottom);
-//     mat[INDEX(3, 0)] = -(far + near) / (far - near);
-//     mat[INDEX(3, 3)] = 1.0f;
-// }
-
-
-// void mat4_translate(mat4 mat, const vec3 translation) {
-//     mat4_identity(mat);
-//     mat[INDEX(3, 0)] = translation[0];
-//     mat[INDEX(3, 1)] = translation[1];
-//     mat[INDEX(3, 2)] = translation[2];
-// }
-
-// void mat4_scale(mat4 mat, const vec3 scale) {
-//     memset(mat, 0, 16 * sizeof(float));
-//     mat[INDEX(0, 0)] = scale[0];
-//     mat[INDEX(1, 1)] = scale[1];
-//     mat[INDEX(2, 2)] = scale[2];
-//     mat[INDEX(3, 3)] = 1.0f;
-// }
-
-// void mat4_look_at(mat4 mat, const vec3 eye, const vec3 object, const vec3 up) {
-//     vec3 f, u, s;
-
-//     // Calculate direction vectors.
-//     vec3_sub(object, eye, f);
-//     vec3_normalize(f, f);
-
-//     vec3_normalize(up, u);
-
-//     vec3_cross(f, u, s);
-//     vec3_normalize(s, s);
-
-//     vec3_cross(s, f, u);
-
-//     memset(mat, 0, 16 * sizeof(float));
-//     mat[INDEX(0, 0)] = s[0];
-//     mat[INDEX(1, 0)] = s[1];
-//     mat[INDEX(2, 0)] = s[2];
-//     mat[INDEX(0, 1)] = u[0];
-//     mat[INDEX(1, 1)] = u[1];
-//     mat[INDEX(2, 1)] = u[2];
-//     mat[INDEX(0, 2)] = -f[0];
-//     mat[INDEX(1, 2)] = -f[1];
-//     mat[INDEX(2, 2)] = -f[2];
-//     mat[INDEX(3, 0)] = -vec3_dot(s, eye);
-//     mat[INDEX(3, 1)] = -vec3_dot(u, eye);
-//     mat[INDEX(3, 2)] = vec3_dot(f, eye);
-//     mat[INDEX(3, 3)] = 1.0f;
-// }
-
-// void mat4_mul(const mat4 a, const mat4 b, mat4 y) {
-//     mat4 temp;
-//     float sum;
-//     for (int r = 0; r < 4; r++) {
-//         for (int c = 0; c < 4; c++) {
-//             sum = 0.0f;
-//             for (int i = 0; i < 4; i++) {
-//                 sum = sum + (a[INDEX(i, r)] * b[INDEX(c, i)]);
-//             }
-//             temp[INDEX(c, r)] = sum;
-//         }
-//     }
-//     memcpy(y, temp, sizeof(float) * 16);
-// }
-
-// void mat4_print(mat4 mat) {
-//     for (int r = 0; r < 4; r++) {
-//         for (int c = 0; c < 4; c++) {
-//             printf("%f ", mat[INDEX(r, c)]);
-//         }
-//         printf("\n");
-//     }
-// }
\ No newline at end of file
+#include "matrix.h"
+
+
+void mat4_identity(mat4 mat) {
+    memset(mat, 0, 16 * sizeof(float));
+    mat[INDEX(0, 0)] = 1.0f;
+    mat[INDEX(1, 1)] = 1.0f;
+    mat[INDEX(2, 2)] = 1.0f;
+    mat[INDEX(3, 3)] = 1.0f;
+}
+
+void mat4_perspective(mat4 mat, float fov, float near, float far, float aspect) {
+    float r = tanf(fov * 0.5f * MATH_PI / 180.0f);
+
+    memset(mat, 0, 16 * sizeof(float));
+    mat[INDEX(0, 0)] = 1.0f / (r * aspect);
+    mat[INDEX(1, 1)] = 1.0f / r;
+    mat[INDEX(2, 2)] = -(far + near) / (far - near);
+    mat[INDEX(3, 2)] = (-2.0f * far * near) / (far - near);
+    mat[INDEX(2, 3)] = -1.0f;
+}
+
+void mat4_orthographic(mat4 mat, float left, float right, float bottom, float top, float near, float far) {
+    memset(mat, 0, 16 * sizeof(float));
+    mat[INDEX(0, 0)] = 2.0f / (right - left);
+    mat[INDEX(1, 1)] = 2.0f / (top - bottom);
+    mat[INDEX(2, 2)] = -2.0f / (far - near);
+    mat[INDEX(3, 0)] = -(right + left) / (right - left);
+    mat[INDEX(3, 1)] = -(top + bottom) / (top - bottom);
+    mat[INDEX(3, 2)] = -(far + near) / (far - near);
+    mat[INDEX(3, 3)] = 1.0f;
+}
+
+
+void mat4_translate(mat4 mat, const vec3 &translation) {
+    mat4_identity(mat);
+    mat[INDEX(3, 0)] = translation[0];
+    mat[INDEX(3, 1)] = translation[1];
+    mat[INDEX(3, 2)] = translation[2];
+}
+
+void mat4_rotate(mat4 mat, const vec3 &axis, float angle) {
+    vec3 a = axis;
+    a.normalize();
+    float rad = angle * MATH_PI / 180.0f;
+    float c = cosf(rad);
+    float s = sinf(rad);
+    float t = 1.0f - c;
+
+    mat4_identity(mat);
+    mat[INDEX(0, 0)] = c + a[0] * a[0] * t;
+    mat[INDEX(1, 0)] = a[0] * a[1] * t - a[2] * s;
+    mat[INDEX(2, 0)] = a[0] * a[2] * t + a[1] * s;
+    mat[INDEX(0, 1)] = a[1] * a[0] * t + a[2] * s;
+    mat[INDEX(1, 1)] = c + a[1] * a[1] * t;
+    mat[INDEX(2, 1)] = a[1] * a[2] * t - a[0] * s;
+    mat[INDEX(0, 2)] = a[2] * a[0] * t - a[1] * s;
+    mat[INDEX(1, 2)] = a[2] * a[1] * t + a[0] * s;
+    mat[INDEX(2, 2)] = c + a[2] * a[2] * t;
+}
+
+void mat4_scale(mat4 mat, const vec3 &scale) {
+    memset(mat, 0, 16 * sizeof(float));
+    mat[INDEX(0, 0)] = scale[0];
+    mat[INDEX(1, 1)] = scale[1];
+    mat[INDEX(2, 2)] = scale[2];
+    mat[INDEX(3, 3)] = 1.0f;
+}
+
+void mat4_look_at(mat4 mat, const vec3 &eye, const vec3 &object, const vec3 &up) {
+    vec3 f, u, s;
+
+    // Calculate direction vectors.
+    f = object - eye;
+    f.normalize();
+
+    u = up;
+    u.normalize();
+
+    s = f.cross(u);
+    s.normalize();
+
+    u = s.cross(f);
+
+    memset(mat, 0, 16 * sizeof(float));
+    mat[INDEX(0, 0)] = s[0];
+    mat[INDEX(1, 0)] = s[1];
+    mat[INDEX(2, 0)] = s[2];
+    mat[INDEX(0, 1)] = u[0];
+    mat[INDEX(1, 1)] = u[1];
+    mat[INDEX(2, 1)] = u[2];
+    mat[INDEX(0, 2)] = -f[0];
+    mat[INDEX(1, 2)] = -f[1];
+    mat[INDEX(2, 2)] = -f[2];
+    mat[INDEX(3, 0)] = -s.dot(eye);
+    mat[INDEX(3, 1)] = -u.dot(eye);
+    mat[INDEX(3, 2)] = f.dot(eye);
+    mat[INDEX(3, 3)] = 1.0f;
+}
+
+void mat4_mul(const mat4 a, const mat4 b, mat4 y) {
+    mat4 temp;
+    float sum;
+    for (int r = 0; r < 4; r++) {
+        for (int c = 0; c < 4; c++) {
+            sum = 0.0f;
+            for (int i = 0; i < 4; i++) {
+                sum = sum + (a[INDEX(i, r)] * b[INDEX(c, i)]);
+            }
+            temp[INDEX(c, r)] = sum;
+        }
+    }
+    memcpy(y, temp, sizeof(float) * 16);
+}
+
+int mat4_inverse(const mat4 mat, mat4 y) {
+    // Cofactor expansion, 2 x 2 sub-determinants of the top and bottom halves
+    const float* m = mat;
+    float s0 = m[0] * m[5] - m[4] * m[1];
+    float s1 = m[0] * m[6] - m[4] * m[2];
+    float s2 = m[0] * m[7] - m[4] * m[3];
+    float s3 = m[1] * m[6] - m[5] * m[2];
+    float s4 = m[1] * m[7] - m[5] * m[3];
+    float s5 = m[2] * m[7] - m[6] * m[3];
+    float c5 = m[10] * m[15] - m[14] * m[11];
+    float c4 = m[9] * m[15] - m[13] * m[11];
+    float c3 = m[9] * m[14] - m[13] * m[10];
+    float c2 = m[8] * m[15] - m[12] * m[11];
+    float c1 = m[8] * m[14] - m[12] * m[10];
+    float c0 = m[8] * m[13] - m[12] * m[9];
+
+    float det = s0 * c5 - s1 * c4 + s2 * c3 + s3 * c2 - s4 * c1 + s5 * c0;
+    if (det == 0.0f) {
+        return -1;
+    }
+    float inv = 1.0f / det;
+
+    mat4 temp;
+    temp[0] = (m[5] * c5 - m[6] * c4 + m[7] * c3) * inv;
+    temp[1] = (-m[1] * c5 + m[2] * c4 - m[3] * c3) * inv;
+    temp[2] = (m[13] * s5 - m[14] * s4 + m[15] * s3) * inv;
+    temp[3] = (-m[9] * s5 + m[10] * s4 - m[11] * s3) * inv;
+    temp[4] = (-m[4] * c5 + m[6] * c2 - m[7] * c1) * inv;
+    temp[5] = (m[0] * c5 - m[2] * c2 + m[3] * c1) * inv;
+    temp[6] = (-m[12] * s5 + m[14] * s2 - m[15] * s1) * inv;
+    temp[7] = (m[8] * s5 - m[10] * s2 + m[11] * s1) * inv;
+    temp[8] = (m[4] * c4 - m[5] * c2 + m[7] * c0) * inv;
+    temp[9] = (-m[0] * c4 + m[1] * c2 - m[3] * c0) * inv;
+    temp[10] = (m[12] * s4 - m[13] * s2 + m[15] * s0) * inv;
+    temp[11] = (-m[8] * s4 + m[9] * s2 - m[11] * s0) * inv;
+    temp[12] = (-m[4] * c3 + m[5] * c1 - m[6] * c0) * inv;
+    temp[13] = (m[0] * c3 - m[1] * c1 + m[2] * c0) * inv;
+    temp[14] = (-m[12] * s3 + m[13] * s1 - m[14] * s0) * inv;
+    temp[15] = (m[8] * s3 - m[9] * s1 + m[10] * s0) * inv;
+    memcpy(y, temp, sizeof(float) * 16);
+    return 0;
+}
+
+vec3 mat4_transform_point(const mat4 mat, const vec3 &p) {
+    return mat4_transform_vector(mat, p) + vec3(mat[INDEX(3, 0)], mat[INDEX(3, 1)], mat[INDEX(3, 2)]);
+}
+
+vec3 mat4_transform_vector(const mat4 mat, const vec3 &v) {
+    return vec3(
+        mat[INDEX(0, 0)] * v[0] + mat[INDEX(1, 0)] * v[1] + mat[INDEX(2, 0)] * v[2],
+        mat[INDEX(0, 1)] * v[0] + mat[INDEX(1, 1)] * v[1] + mat[INDEX(2, 1)] * v[2],
+        mat[INDEX(0, 2)] * v[0] + mat[INDEX(1, 2)] * v[1] + mat[INDEX(2, 2)] * v[2]
+    );
+}
+
+void mat4_print(const mat4 mat) {
+    for (int r = 0; r < 4; r++) {
+        for (int c = 0; c < 4; c++) {
+            printf("%f ", mat[INDEX(c, r)]);
+        }
+        printf("\n");
+    }
+}
@@ -0,0 +1,277 @@
+#include "obj.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+// Bytes read per chunk, also the longest line that can be parsed
+#define OBJ_CHUNK (1 << 20)
+
+struct obj_state {
+    const char* file;
+    int32_t material;
+    std::vector<float>* positions;
+    std::vector<float>* normals;
+    std::vector<float>* uvs;
+    std::vector<Triangle>* triangles;
+
+    // Counts already in the arrays before this file, OBJ indices are
+    // relative to the start of the file
+    int32_t base_p, base_n, base_t;
+    size_t line;
+};
+
+static const double pow10_table[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10,
+    1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+static inline const char* skip_space(const char* p) {
+    while (*p == ' ' || *p == '\t' || *p == '\r') {
+        p++;
+    }
+    return p;
+}
+
+static inline bool is_digit(char c) {
+    return c >= '0' && c <= '9';
+}
+
+// Locale independent float parser, returns NULL if no number was found
+static const char* parse_float(const char* p, float &out) {
+    p = skip_space(p);
+    bool negative = *p == '-';
+    if (*p == '-' || *p == '+') {
+        p++;
+    }
+
+    uint64_t mantissa = 0;
+    int digits = 0;
+    int exponent = 0;
+    bool found = false;
+    for (; is_digit(*p); p++) {
+        found = true;
+        if (digits < 19) {
+            mantissa = mantissa * 10 + (*p - '0');
+            digits += mantissa != 0;
+        } else {
+            exponent++;
+        }
+    }
+    if (*p == '.') {
+        for (p++; is_digit(*p); p++) {
+            found = true;
+            if (digits < 19) {
+                mantissa = mantissa * 10 + (*p - '0');
+                digits += mantissa != 0;
+                exponent--;
+            }
+        }
+    }
+    if (!found) {
+        return NULL;
+    }
+    if (*p == 'e' || *p == 'E') {
+        p++;
+        bool negative_exp = *p == '-';
+        if (*p == '-' || *p == '+') {
+            p++;
+        }
+        int e = 0;
+        for (; is_digit(*p); p++) {
+            e = e < 10000 ? e * 10 + (*p - '0') : e;
+        }
+        exponent += negative_exp ? -e : e;
+    }
+
+    double value = (double) mantissa;
+    if (exponent >= 0) {
+        value *= exponent <= 22 ? pow10_table[exponent] : pow(10.0, exponent);
+    } else {
+        value /= -exponent <= 22 ? pow10_table[-exponent] : pow(10.0, -exponent);
+    }
+    out = (float) (negative ? -value : value);
+    return p;
+}
+
+static const char* parse_int(const char* p, int64_t &out) {
+    bool negative = *p == '-';
+    if (*p == '-' || *p == '+') {
+        p++;
+    }
+    if (!is_digit(*p)) {
+        return NULL;
+    }
+    int64_t value = 0;
+    for (; is_digit(*p); p++) {
+        value = value < ((int64_t) 1 << 40) ? value * 10 + (*p - '0') : value;
+    }
+    out = negative ? -value : value;
+    return p;
+}
+
+// Resolves a 1-based or negative OBJ index to an index into the arrays
+static bool resolve(int64_t index, int32_t base, int32_t count, int32_t &out) {
+    int64_t i = index > 0 ? base + index - 1 : count + index;
+    if (index == 0 || i < base || i >= count) {
+        return false;
+    }
+    out = (int32_t) i;
+    return true;
+}
+
+// Parses one face corner: v, v/t, v//n or v/t/n
+static const char* parse_corner(obj_state &s, const char* p, int32_t &v, int32_t &t, int32_t &n) {
+    int32_t count_p = (int32_t) (s.positions->size() / 3);
+    int32_t count_t = (int32_t) (s.uvs->size() / 2);
+    int32_t count_n = (int32_t) (s.normals->size() / 3);
+
+    int64_t index;
+    t = -1;
+    n = -1;
+    if (!(p = parse_int(p, index)) || !resolve(index, s.base_p, count_p, v)) {
+        return NULL;
+    }
+    if (*p != '/') {
+        return p;
+    }
+    p++;
+    if (*p != '/') {
+        if (!(p = parse_int(p, index)) || !resolve(index, s.base_t, count_t, t)) {
+            return NULL;
+        }
+    }
+    if (*p != '/') {
+        return p;
+    }
+    p++;
+    if (!(p = parse_int(p, index)) || !resolve(index, s.base_n, count_n, n)) {
+        return NULL;
+    }
+    return p;
+}
+
+static int parse_line(obj_state &s, const char* p) {
+    p = skip_space(p);
+    float x, y, z;
+
+    if (p[0] == 'v' && (p[1] == ' ' || p[1] == '\t')) {
+        if (!(p = parse_float(p + 1, x)) || !(p = parse_float(p, y)) || !(p = parse_float(p, z))) {
+            return -1;
+        }
+        s.positions->push_back(x);
+        s.positions->push_back(y);
+        s.positions->push_back(z);
+    } else if (p[0] == 'v' && p[1] == 'n') {
+        if (!(p = parse_float(p + 2, x)) || !(p = parse_float(p, y)) || !(p = parse_float(p, z))) {
+            return -1;
+        }
+        s.normals->push_back(x);
+        s.normals->push_back(y);
+        s.normals->push_back(z);
+    } else if (p[0] == 'v' && p[1] == 't') {
+        if (!(p = parse_float(p + 2, x)) || !(p = parse_float(p, y))) {
+            return -1;
+        }
+        s.uvs->push_back(x);
+        s.uvs->push_back(y);
+    } else if (p[0] == 'f' && (p[1] == ' ' || p[1] == '\t')) {
+        // Fan triangulate without storing the polygon
+        Triangle tri;
+        tri.material = s.material;
+        int corners = 0;
+        p = skip_space(p + 1);
+        while (*p != '\n' && *p != '#') {
+            int32_t v, t, n;
+            if (!(p = parse_corner(s, p, v, t, n))) {
+                return -1;
+            }
+            int c = corners < 2 ? corners : 2;
+            if (corners >= 3) {
+                tri.p[1] = tri.p[2];
+                tri.t[1] = tri.t[2];
+                tri.n[1] = tri.n[2];
+            }
+            tri.p[c] = v;
+            tri.t[c] = t;
+            tri.n[c] = n;
+            if (++corners >= 3) {
+                s.triangles->push_back(tri);
+            }
+            p = skip_space(p);
+        }
+        if (corners < 3) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+int obj_load(const char* file, int32_t material,
+             std::vector<float> &positions,
+             std::vector<float> &normals,
+             std::vector<float> &uvs,
+             std::vector<Triangle> &triangles) {
+    FILE* f = fopen(file, "rb");
+    if (!f) {
+        fprintf(stderr, "ERROR: Unable to open mesh %s!\n", file);
+        return -1;
+    }
+
+    obj_state s;
+    s.file = file;
+    s.material = material;
+    s.positions = &positions;
+    s.normals = &normals;
+    s.uvs = &uvs;
+    s.triangles = &triangles;
+    s.base_p = (int32_t) (positions.size() / 3);
+    s.base_n = (int32_t) (normals.size() / 3);
+    s.base_t = (int32_t) (uvs.size() / 2);
+    s.line = 0;
+
+    // One chunk plus room for a terminating newline
+    std::vector<char> buffer(OBJ_CHUNK + 2);
+    char* buf = buffer.data();
+    size_t filled = 0;
+    bool eof = false;
+    while (!eof || filled > 0) {
+        if (!eof) {
+            size_t n = fread(buf + filled, 1, OBJ_CHUNK - filled, f);
+            filled += n;
+            eof = n == 0 || feof(f);
+        }
+
+        // Only parse whole lines, the tail waits for the next chunk
+        size_t end = filled;
+        while (end > 0 && buf[end - 1] != '\n') {
+            end--;
+        }
+        if (end == 0) {
+            if (!eof) {
+                fprintf(stderr, "ERROR: %s:%zu: line is too long!\n", file, s.line + 1);
+                fclose(f);
+                return -1;
+            }
+            buf[filled] = '\n';
+            end = filled + 1;
+        }
+
+        for (size_t start = 0; start < end;) {
+            char* nl = (char*) memchr(buf + start, '\n', end - start);
+            s.line++;
+            if (parse_line(s, buf + start)) {
+                fprintf(stderr, "ERROR: %s:%zu: malformed record!\n", file, s.line);
+                fclose(f);
+                return -1;
+            }
+            start = (size_t) (nl - buf) + 1;
+        }
+
+        filled = end < filled ? filled - end : 0;
+        memmove(buf, buf + end, filled);
+    }
+
+    fclose(f);
+    return 0;
+}
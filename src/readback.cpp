@@ -0,0 +1,163 @@
+#include "readback.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include "image.h"
+
+Readback::Readback() {
+    for (int i = 0; i < READBACK_SLOTS; i++) {
+        this->m_slots[i].buffer = 0;
+        this->m_slots[i].fence = 0;
+    }
+    this->m_width = 0;
+    this->m_height = 0;
+    this->m_next = 0;
+    this->m_pending = 0;
+    this->m_busy = false;
+    this->m_stop = false;
+    this->m_failed = 0;
+}
+
+Readback::~Readback() {
+    if (this->m_writer.joinable()) {
+        {
+            std::lock_guard<std::mutex> guard(this->m_lock);
+            this->m_stop = true;
+        }
+        this->m_wake.notify_all();
+        this->m_writer.join();
+    }
+
+    for (int i = 0; i < READBACK_SLOTS; i++) {
+        if (this->m_slots[i].fence) {
+            glDeleteSync(this->m_slots[i].fence);
+        }
+        glDeleteBuffers(1, &this->m_slots[i].buffer);
+    }
+}
+
+int Readback::create(int width, int height) {
+    this->m_width = width;
+    this->m_height = height;
+
+    size_t bytes = size_t(width) * size_t(height) * 4 * sizeof(float);
+    for (int i = 0; i < READBACK_SLOTS; i++) {
+        glGenBuffers(1, &this->m_slots[i].buffer);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, this->m_slots[i].buffer);
+        glBufferData(GL_PIXEL_PACK_BUFFER, bytes, NULL, GL_STREAM_READ);
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    if (glGetError() != GL_NO_ERROR) {
+        fprintf(stderr, "ERROR: Failed to allocate %d readback buffers of %zu bytes\n", READBACK_SLOTS, bytes);
+        return -1;
+    }
+
+    this->m_writer = std::thread(&Readback::write, this);
+    return 0;
+}
+
+int Readback::request(GLuint texture, const char* file) {
+    if (this->m_pending == READBACK_SLOTS) {
+        return -1;
+    }
+
+    // With a pack buffer bound the pixels go into it, not to the host
+    Slot &slot = this->m_slots[this->m_next];
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_FLOAT, NULL);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    slot.file = file;
+
+    this->m_next = (this->m_next + 1) % READBACK_SLOTS;
+    this->m_pending++;
+    return 0;
+}
+
+void Readback::poll() {
+    while (this->m_pending) {
+        Slot &slot = this->m_slots[(this->m_next + READBACK_SLOTS - this->m_pending) % READBACK_SLOTS];
+        GLenum status = glClientWaitSync(slot.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+        if (status == GL_TIMEOUT_EXPIRED || status == GL_WAIT_FAILED) {
+            return;
+        }
+        this->collect(slot);
+    }
+}
+
+int Readback::finish() {
+    while (this->m_pending) {
+        Slot &slot = this->m_slots[(this->m_next + READBACK_SLOTS - this->m_pending) % READBACK_SLOTS];
+        while (glClientWaitSync(slot.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000) == GL_TIMEOUT_EXPIRED) {
+        }
+        this->collect(slot);
+    }
+
+    std::unique_lock<std::mutex> guard(this->m_lock);
+    this->m_idle.wait(guard, [this] { return this->m_jobs.empty() && !this->m_busy; });
+    int failed = this->m_failed;
+    this->m_failed = 0;
+    return failed ? -1 : 0;
+}
+
+void Readback::collect(Slot &slot) {
+    glDeleteSync(slot.fence);
+    slot.fence = 0;
+    this->m_pending--;
+
+    // The copy out of the mapping is the only work left on this thread
+    Job job;
+    job.pixels.resize(size_t(this->m_width) * size_t(this->m_height) * 4);
+    job.file = slot.file;
+    size_t bytes = job.pixels.size() * sizeof(float);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+    const void* mapped = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, bytes, GL_MAP_READ_BIT);
+    if (mapped) {
+        memcpy(job.pixels.data(), mapped, bytes);
+        glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    std::lock_guard<std::mutex> guard(this->m_lock);
+    if (!mapped) {
+        fprintf(stderr, "ERROR: Failed to map the readback of %s\n", job.file.c_str());
+        this->m_failed++;
+        return;
+    }
+    this->m_jobs.push_back(std::move(job));
+    this->m_wake.notify_one();
+}
+
+void Readback::write() {
+    std::unique_lock<std::mutex> guard(this->m_lock);
+    for (;;) {
+        this->m_wake.wait(guard, [this] { return this->m_stop || !this->m_jobs.empty(); });
+        if (this->m_jobs.empty()) {
+            return;
+        }
+        Job job = std::move(this->m_jobs.front());
+        this->m_jobs.pop_front();
+        this->m_busy = true;
+        guard.unlock();
+
+        // Row 0 of the texture is the bottom of the image
+        Image image(this->m_width, this->m_height);
+        for (int y = 0; y < this->m_height; y++) {
+            for (int x = 0; x < this->m_width; x++) {
+                const float* p = &job.pixels[((size_t) y * this->m_width + x) * 4];
+                float n = p[3] > 0.0f ? p[3] : 1.0f;
+                image.set(x, this->m_height - 1 - y, vec3(p[0], p[1], p[2]) / n);
+            }
+        }
+        int status = image.save(job.file.c_str());
+
+        guard.lock();
+        this->m_busy = false;
+        if (status) {
+            this->m_failed++;
+        }
+        this->m_idle.notify_all();
+    }
+}
@@ -0,0 +1,698 @@
+#include "scene.h"
+
+#include "obj.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include <algorithm>
+#include <fstream>
+#include <map>
+#include <sstream>
+
+#if defined(_WIN32) || defined(_WIN64)
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Padding given to flat primitives so their boxes have volume
+#define BVH_EPSILON 0.0001f
+
+Scene::Scene() {
+    this->camera.position = vec3(0.0f);
+    this->camera.lookat = vec3(0.0f, 0.0f, 1.0f);
+    this->camera.up = vec3(0.0f, 1.0f, 0.0f);
+    this->camera.fov = 40.0f;
+    this->camera.aperture = 0.0f;
+    this->camera.focus = 10.0f;
+
+    TextureDesc none = {};
+    none.type = TEX_SOLID;
+    none.image = -1;
+    this->m_textures.push_back(none);
+    this->textures = this->m_textures;
+
+    this->m_map = NULL;
+    this->m_map_size = 0;
+}
+
+Scene::~Scene() {
+    this->unmap();
+}
+
+static int lookup(const std::map<std::string, int32_t> &names, const std::string &name, int32_t &index) {
+    auto it = names.find(name);
+    if (it == names.end()) {
+        return -1;
+    }
+    index = it->second;
+    return 0;
+}
+
+int Scene::load(const char* file) {
+    const char* ext = strrchr(file, '.');
+    int status = ext && !strcmp(ext, ".rtscene") ? this->load_binary(file) : this->load_text(file);
+    if (status) {
+        return status;
+    }
+
+    // Traversal pushes at most one node per interior level onto a stack of
+    // BVH_MAX_DEPTH entries, in the shaders and on the CPU alike
+    int depth = bvh_depth(this->nodes.data, this->nodes.size(), 0);
+    for (size_t i = 0; depth >= 0 && i < this->instances.size(); i++) {
+        int d = bvh_depth(this->nodes.data, this->nodes.size(), this->instances[i].root);
+        depth = d < 0 ? -1 : std::max(depth, d);
+    }
+    if (depth < 0) {
+        fprintf(stderr, "ERROR: BVH of %s references a node out of range!\n", file);
+        return -1;
+    }
+    if (depth - 1 > BVH_MAX_DEPTH) {
+        fprintf(stderr, "ERROR: BVH of %s is %d levels deep, traversal supports %d!\n", file, depth, BVH_MAX_DEPTH + 1);
+        return -1;
+    }
+    return 0;
+}
+
+int Scene::load_text(const char* file) {
+    std::ifstream ifs(file);
+    if (!ifs) {
+        fprintf(stderr, "ERROR: Unable to open scene %s!\n", file);
+        return -1;
+    }
+
+    std::map<std::string, int32_t> texture_names;
+    std::map<std::string, int32_t> material_names;
+    std::map<std::string, int32_t> object_names;
+    texture_names["none"] = 0;
+    this->m_objects.clear();
+    this->m_placements.clear();
+
+    std::string line;
+    int number = 0;
+    while (std::getline(ifs, line)) {
+        number++;
+        size_t comment = line.find('#');
+        if (comment != std::string::npos) {
+            line.erase(comment);
+        }
+
+        std::istringstream in(line);
+        std::string directive;
+        if (!(in >> directive)) {
+            continue;
+        }
+
+        bool ok = true;
+        if (directive == "camera") {
+            CameraDesc &c = this->camera;
+            ok = (bool) (in >> c.position[0] >> c.position[1] >> c.position[2]
+                            >> c.lookat[0] >> c.lookat[1] >> c.lookat[2]
+                            >> c.up[0] >> c.up[1] >> c.up[2]
+                            >> c.fov >> c.aperture >> c.focus);
+        } else if (directive == "texture") {
+            std::string name, type;
+            TextureDesc t = {};
+            t.image = -1;
+            in >> name >> type;
+            if (type == "solid") {
+                t.type = TEX_SOLID;
+                ok = (bool) (in >> t.color[0] >> t.color[1] >> t.color[2]);
+            } else if (type == "image") {
+                std::string image;
+                ok = (bool) (in >> image);
+                if (ok && this->images.size() >= MAX_IMAGES) {
+                    fprintf(stderr, "ERROR: %s:%d: at most %d images are supported!\n", file, number, MAX_IMAGES);
+                    return -1;
+                }
+                t.type = TEX_IMAGE;
+                t.image = (int32_t) this->images.size();
+                this->images.push_back(image);
+            } else {
+                ok = false;
+            }
+            texture_names[name] = (int32_t) this->m_textures.size();
+            this->m_textures.push_back(t);
+        } else if (directive == "material") {
+            std::string name, type, albedo, emit;
+            Material m = { MAT_LAMBERTIAN, 0, 0, 0.0f };
+            in >> name >> type;
+            if (type == "lambertian") {
+                m.type = MAT_LAMBERTIAN;
+                ok = (in >> albedo) && !lookup(texture_names, albedo, m.albedo);
+            } else if (type == "metal") {
+                m.type = MAT_METAL;
+                ok = (in >> albedo >> m.v) && !lookup(texture_names, albedo, m.albedo);
+            } else if (type == "dielectric") {
+                m.type = MAT_DIELECTRIC;
+                ok = (bool) (in >> m.v);
+            } else if (type == "light") {
+                m.type = MAT_DIFFUSE_LIGHT;
+                ok = (in >> emit) && !lookup(texture_names, emit, m.emit);
+            } else {
+                ok = false;
+            }
+            material_names[name] = (int32_t) this->m_materials.size();
+            this->m_materials.push_back(m);
+        } else if (directive == "sphere") {
+            std::string material;
+            Sphere s = {};
+            ok = (in >> s.center[0] >> s.center[1] >> s.center[2] >> s.radius >> material)
+                && !lookup(material_names, material, s.material);
+            this->m_spheres.push_back(s);
+        } else if (directive == "rect") {
+            std::string type, material;
+            Rect r = {};
+            ok = (in >> type >> r.a0 >> r.a1 >> r.b0 >> r.b1 >> r.k >> material)
+                && !lookup(material_names, material, r.material);
+            if (type == "xy") {
+                r.type = RECT_XY;
+            } else if (type == "xz") {
+                r.type = RECT_XZ;
+            } else if (type == "yz") {
+                r.type = RECT_YZ;
+            } else {
+                ok = false;
+            }
+            this->m_rects.push_back(r);
+        } else if (directive == "mesh" || directive == "object") {
+            std::string name, mesh, material;
+            int32_t index;
+            ok = (directive == "mesh" || (in >> name)) && (in >> mesh >> material)
+                && !lookup(material_names, material, index);
+            size_t first = this->m_triangles.size();
+            if (ok && obj_load(mesh.c_str(), index, this->m_positions, this->m_normals, this->m_uvs, this->m_triangles)) {
+                return -1;
+            }
+
+            Object object;
+            for (size_t i = first; i < this->m_triangles.size(); i++) {
+                object.refs.push_back(PRIM_REF(PRIM_TRIANGLE, (int32_t) i));
+            }
+            int32_t id = (int32_t) this->m_objects.size();
+            this->m_objects.push_back(object);
+            if (directive == "mesh") {
+                Placement p;
+                p.object = id;
+                mat4_identity(p.to_world);
+                this->m_placements.push_back(p);
+            } else {
+                object_names[name] = id;
+            }
+        } else if (directive == "instance") {
+            std::string object;
+            vec3 t, r;
+            float scale;
+            Placement p;
+            ok = (in >> object >> t[0] >> t[1] >> t[2] >> r[0] >> r[1] >> r[2] >> scale)
+                && !lookup(object_names, object, p.object) && scale != 0.0f;
+
+            // T * Rz * Ry * Rx * S
+            mat4 m;
+            mat4_translate(p.to_world, t);
+            mat4_rotate(m, vec3(0.0f, 0.0f, 1.0f), r[2]);
+            mat4_mul(p.to_world, m, p.to_world);
+            mat4_rotate(m, vec3(0.0f, 1.0f, 0.0f), r[1]);
+            mat4_mul(p.to_world, m, p.to_world);
+            mat4_rotate(m, vec3(1.0f, 0.0f, 0.0f), r[0]);
+            mat4_mul(p.to_world, m, p.to_world);
+            mat4_scale(m, vec3(scale));
+            mat4_mul(p.to_world, m, p.to_world);
+            this->m_placements.push_back(p);
+        } else {
+            fprintf(stderr, "ERROR: %s:%d: unknown directive \"%s\"!\n", file, number, directive.c_str());
+            return -1;
+        }
+
+        if (!ok) {
+            fprintf(stderr, "ERROR: %s:%d: malformed %s!\n", file, number, directive.c_str());
+            return -1;
+        }
+    }
+
+    this->textures = this->m_textures;
+    this->materials = this->m_materials;
+    this->spheres = this->m_spheres;
+    this->rects = this->m_rects;
+    this->positions = this->m_positions;
+    this->normals = this->m_normals;
+    this->uvs = this->m_uvs;
+    this->triangles = this->m_triangles;
+
+    // Emissive rects are sampled directly, always in world space as the
+    // rects' object is never transformed
+    this->m_lights.clear();
+    for (size_t i = 0; i < this->m_rects.size(); i++) {
+        if (this->m_materials[this->m_rects[i].material].type == MAT_DIFFUSE_LIGHT) {
+            this->m_lights.push_back((int32_t) i);
+        }
+    }
+    this->lights = this->m_lights;
+
+    // Spheres and rects are placed once, as is
+    Object shapes;
+    for (size_t i = 0; i < this->spheres.size(); i++) {
+        shapes.refs.push_back(PRIM_REF(PRIM_SPHERE, (int32_t) i));
+    }
+    for (size_t i = 0; i < this->rects.size(); i++) {
+        shapes.refs.push_back(PRIM_REF(PRIM_RECT, (int32_t) i));
+    }
+    if (!shapes.refs.empty()) {
+        Placement p;
+        p.object = (int32_t) this->m_objects.size();
+        mat4_identity(p.to_world);
+        this->m_objects.push_back(shapes);
+        this->m_placements.push_back(p);
+    }
+
+    this->build_bvh();
+    return 0;
+}
+
+AABB Scene::bounds(int32_t ref) const {
+    int32_t index = PRIM_INDEX(ref);
+    switch (PRIM_KIND(ref)) {
+        case PRIM_SPHERE: {
+            const Sphere &s = this->spheres[index];
+            return AABB(s.center - vec3(s.radius), s.center + vec3(s.radius));
+        }
+        case PRIM_RECT: {
+            const Rect &r = this->rects[index];
+            if (r.type == RECT_XY) {
+                return AABB(vec3(r.a0, r.b0, r.k - BVH_EPSILON), vec3(r.a1, r.b1, r.k + BVH_EPSILON));
+            } else if (r.type == RECT_XZ) {
+                return AABB(vec3(r.a0, r.k - BVH_EPSILON, r.b0), vec3(r.a1, r.k + BVH_EPSILON, r.b1));
+            }
+            return AABB(vec3(r.k - BVH_EPSILON, r.a0, r.b0), vec3(r.k + BVH_EPSILON, r.a1, r.b1));
+        }
+        case PRIM_TRIANGLE: {
+            const Triangle &t = this->triangles[index];
+            AABB box;
+            for (int i = 0; i < 3; i++) {
+                const float* p = &this->positions[(size_t) t.p[i] * 3];
+                box.grow(vec3(p[0], p[1], p[2]));
+            }
+            return box;
+        }
+    }
+    return AABB();
+}
+
+void Scene::build_bvh() {
+    // Bottom level, one BVH per object over its primitives in object space
+    std::vector<BVH> objects(this->m_objects.size());
+    for (size_t i = 0; i < this->m_objects.size(); i++) {
+        const std::vector<int32_t> &refs = this->m_objects[i].refs;
+        std::vector<AABB> boxes;
+        boxes.reserve(refs.size());
+        for (int32_t ref : refs) {
+            boxes.push_back(this->bounds(ref));
+        }
+        objects[i].build(boxes, refs);
+    }
+
+    // Top level over the world space bounds of every instance
+    std::vector<AABB> boxes;
+    std::vector<int32_t> refs;
+    std::vector<int32_t> instance_objects;
+    this->m_instances.clear();
+    for (const Placement &p : this->m_placements) {
+        if (this->m_objects[p.object].refs.empty()) {
+            continue;
+        }
+
+        const BVHNode &root = objects[p.object].nodes[0];
+        AABB box;
+        for (int corner = 0; corner < 8; corner++) {
+            vec3 c(
+                corner & 1 ? root.max[0] : root.min[0],
+                corner & 2 ? root.max[1] : root.min[1],
+                corner & 4 ? root.max[2] : root.min[2]
+            );
+            box.grow(mat4_transform_point(p.to_world, c));
+        }
+
+        mat4 to_object;
+        mat4_inverse(p.to_world, to_object);
+        Instance instance = {};
+        for (int r = 0; r < 3; r++) {
+            for (int c = 0; c < 4; c++) {
+                instance.to_object[r * 4 + c] = to_object[INDEX(c, r)];
+            }
+        }
+
+        boxes.push_back(box);
+        refs.push_back((int32_t) this->m_instances.size());
+        instance_objects.push_back(p.object);
+        this->m_instances.push_back(instance);
+    }
+    BVH top;
+    top.build(boxes, refs);
+
+    this->m_nodes.clear();
+    this->m_prims.clear();
+    top.append(this->m_nodes, this->m_prims);
+    std::vector<int32_t> roots(objects.size());
+    for (size_t i = 0; i < objects.size(); i++) {
+        roots[i] = objects[i].append(this->m_nodes, this->m_prims);
+    }
+    for (size_t i = 0; i < this->m_instances.size(); i++) {
+        this->m_instances[i].root = roots[instance_objects[i]];
+    }
+
+    this->instances = this->m_instances;
+    this->nodes = this->m_nodes;
+    this->prims = this->m_prims;
+}
+
+int Scene::load_binary(const char* file) {
+    this->unmap();
+
+#if defined(_WIN32) || defined(_WIN64)
+    HANDLE fd = CreateFileA(file, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (fd == INVALID_HANDLE_VALUE) {
+        fprintf(stderr, "ERROR: Unable to open scene %s!\n", file);
+        return -1;
+    }
+    LARGE_INTEGER size;
+    GetFileSizeEx(fd, &size);
+    HANDLE mapping = CreateFileMappingA(fd, NULL, PAGE_READONLY, 0, 0, NULL);
+    void* map = mapping ? MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : NULL;
+    if (mapping) {
+        CloseHandle(mapping);
+    }
+    CloseHandle(fd);
+    if (!map) {
+        fprintf(stderr, "ERROR: Unable to map scene %s!\n", file);
+        return -1;
+    }
+    this->m_map_size = (size_t) size.QuadPart;
+#else
+    int fd = open(file, O_RDONLY);
+    if (fd < 0) {
+        fprintf(stderr, "ERROR: Unable to open scene %s!\n", file);
+        return -1;
+    }
+    struct stat st;
+    fstat(fd, &st);
+    void* map = mmap(NULL, (size_t) st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        fprintf(stderr, "ERROR: Unable to map scene %s!\n", file);
+        return -1;
+    }
+    // Everything is about to be streamed to the GPU front to back
+    madvise(map, (size_t) st.st_size, MADV_SEQUENTIAL);
+    madvise(map, (size_t) st.st_size, MADV_WILLNEED);
+    this->m_map_size = (size_t) st.st_size;
+#endif
+    this->m_map = map;
+
+    // Validate the header and every section before pointing into them
+    const SceneFileHeader* header = (const SceneFileHeader*) map;
+    if (this->m_map_size < sizeof(SceneFileHeader) || header->magic != RTSCENE_MAGIC) {
+        fprintf(stderr, "ERROR: %s is not an .rtscene file!\n", file);
+        this->unmap();
+        return -1;
+    }
+    if (header->version != RTSCENE_VERSION) {
+        fprintf(stderr, "ERROR: %s is version %u, expected %u!\n", file, header->version, RTSCENE_VERSION);
+        this->unmap();
+        return -1;
+    }
+    // Alignment of each section's element type, sections are read in place
+    static const size_t aligns[SECTION_COUNT] = {
+        alignof(TextureDesc), alignof(Material), alignof(Sphere), alignof(Rect),
+        alignof(BVHNode), alignof(int32_t), 1, alignof(float), alignof(float),
+        alignof(float), alignof(Triangle), alignof(Instance), alignof(int32_t)
+    };
+    for (int i = 0; i < SECTION_COUNT; i++) {
+        if (header->sections[i].offset > this->m_map_size
+            || header->sections[i].size > this->m_map_size - header->sections[i].offset) {
+            fprintf(stderr, "ERROR: %s is truncated!\n", file);
+            this->unmap();
+            return -1;
+        }
+        if (header->sections[i].offset % aligns[i]) {
+            fprintf(stderr, "ERROR: Section %d of %s is misaligned!\n", i, file);
+            this->unmap();
+            return -1;
+        }
+    }
+
+    const char* base = (const char*) map;
+    #define SECTION(name, type) ArrayView<type>( \
+        (const type*) (base + header->sections[name].offset), header->sections[name].size / sizeof(type))
+    this->textures = SECTION(SECTION_TEXTURES, TextureDesc);
+    this->materials = SECTION(SECTION_MATERIALS, Material);
+    this->spheres = SECTION(SECTION_SPHERES, Sphere);
+    this->rects = SECTION(SECTION_RECTS, Rect);
+    this->nodes = SECTION(SECTION_BVH_NODES, BVHNode);
+    this->prims = SECTION(SECTION_BVH_PRIMS, int32_t);
+    this->positions = SECTION(SECTION_POSITIONS, float);
+    this->normals = SECTION(SECTION_NORMALS, float);
+    this->uvs = SECTION(SECTION_UVS, float);
+    this->triangles = SECTION(SECTION_TRIANGLES, Triangle);
+    this->instances = SECTION(SECTION_INSTANCES, Instance);
+    this->lights = SECTION(SECTION_LIGHTS, int32_t);
+    #undef SECTION
+    this->camera = header->camera;
+
+    if (this->nodes.empty()) {
+        fprintf(stderr, "ERROR: %s has no BVH!\n", file);
+        this->unmap();
+        return -1;
+    }
+
+    this->images.clear();
+    const char* names = base + header->sections[SECTION_IMAGES].offset;
+    const char* names_end = names + header->sections[SECTION_IMAGES].size;
+    while (names < names_end) {
+        size_t len = strnlen(names, names_end - names);
+        this->images.push_back(std::string(names, len));
+        names += len + 1;
+    }
+
+    if (this->validate(file)) {
+        this->unmap();
+        return -1;
+    }
+    return 0;
+}
+
+// Checks that the corners of a triangle index an array of count vertices,
+// optional corners may all be -1 instead
+static bool corners_valid(const int32_t* corners, size_t count, bool optional) {
+    if (optional && corners[0] < 0) {
+        return corners[1] < 0 && corners[2] < 0;
+    }
+    for (int i = 0; i < 3; i++) {
+        if (corners[i] < 0 || (size_t) corners[i] >= count) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Walks the BVH below root and checks every primitive it references
+template <typename F>
+static bool leaves_valid(const ArrayView<BVHNode> &nodes, const ArrayView<int32_t> &prims, int32_t root, F valid) {
+    std::vector<int32_t> stack(1, root);
+    while (!stack.empty()) {
+        int32_t index = stack.back();
+        stack.pop_back();
+        const BVHNode &n = nodes[index];
+        if (n.count == 0) {
+            stack.push_back(index + 1);
+            stack.push_back(n.next);
+            continue;
+        }
+        for (int32_t i = 0; i < n.count; i++) {
+            if (!valid(prims[n.next + i])) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+int Scene::validate(const char* file) const {
+    // Interior nodes only point forward so every walk below terminates
+    for (size_t i = 0; i < this->nodes.size(); i++) {
+        const BVHNode &n = this->nodes[i];
+        bool ok = n.count > 0
+            ? n.next >= 0 && (size_t) n.next <= this->prims.size() && (size_t) n.count <= this->prims.size() - n.next
+            : n.count == 0 && i + 1 < this->nodes.size() && (size_t) n.next > i && (size_t) n.next < this->nodes.size();
+        if (!ok) {
+            fprintf(stderr, "ERROR: BVH node %zu of %s is out of range!\n", i, file);
+            return -1;
+        }
+    }
+
+    auto material_valid = [&](int32_t material) {
+        return material >= 0 && (size_t) material < this->materials.size();
+    };
+    auto prim_valid = [&](int32_t ref) {
+        if (ref < 0) {
+            return false;
+        }
+        size_t index = (size_t) PRIM_INDEX(ref);
+        switch (PRIM_KIND(ref)) {
+            case PRIM_SPHERE:
+                return index < this->spheres.size();
+            case PRIM_RECT:
+                return index < this->rects.size();
+            case PRIM_TRIANGLE:
+                return index < this->triangles.size();
+        }
+        return false;
+    };
+    auto instance_valid = [&](int32_t instance) {
+        return instance >= 0 && (size_t) instance < this->instances.size();
+    };
+
+    // The top level BVH references instances, each object's BVH primitives
+    if (!leaves_valid(this->nodes, this->prims, 0, instance_valid)) {
+        fprintf(stderr, "ERROR: %s references a missing instance!\n", file);
+        return -1;
+    }
+    std::vector<bool> checked(this->nodes.size(), false);
+    for (const Instance &instance : this->instances) {
+        if (instance.root < 0 || (size_t) instance.root >= this->nodes.size()) {
+            fprintf(stderr, "ERROR: Instance root %d of %s is out of range!\n", instance.root, file);
+            return -1;
+        }
+        if (checked[instance.root]) {
+            continue;
+        }
+        checked[instance.root] = true;
+        if (!leaves_valid(this->nodes, this->prims, instance.root, prim_valid)) {
+            fprintf(stderr, "ERROR: %s references a missing primitive!\n", file);
+            return -1;
+        }
+    }
+
+    for (const Sphere &s : this->spheres) {
+        if (!material_valid(s.material)) {
+            fprintf(stderr, "ERROR: Sphere of %s has material %d out of range!\n", file, s.material);
+            return -1;
+        }
+    }
+    for (const Rect &r : this->rects) {
+        if (!material_valid(r.material)) {
+            fprintf(stderr, "ERROR: Rect of %s has material %d out of range!\n", file, r.material);
+            return -1;
+        }
+    }
+    for (const Triangle &t : this->triangles) {
+        if (!corners_valid(t.p, this->positions.size() / 3, false)
+            || !corners_valid(t.n, this->normals.size() / 3, true)
+            || !corners_valid(t.t, this->uvs.size() / 2, true)) {
+            fprintf(stderr, "ERROR: Triangle of %s has a vertex out of range!\n", file);
+            return -1;
+        }
+        if (!material_valid(t.material)) {
+            fprintf(stderr, "ERROR: Triangle of %s has material %d out of range!\n", file, t.material);
+            return -1;
+        }
+    }
+
+    for (const Material &m : this->materials) {
+        if ((m.albedo < 0 || (size_t) m.albedo >= this->textures.size())
+            || (m.emit < 0 || (size_t) m.emit >= this->textures.size())) {
+            fprintf(stderr, "ERROR: Material of %s has a texture out of range!\n", file);
+            return -1;
+        }
+    }
+    if (this->images.size() > MAX_IMAGES) {
+        fprintf(stderr, "ERROR: %s has %zu images, at most %d are supported!\n", file, this->images.size(), MAX_IMAGES);
+        return -1;
+    }
+    for (const TextureDesc &t : this->textures) {
+        if (t.type == TEX_IMAGE && (t.image < 0 || (size_t) t.image >= this->images.size())) {
+            fprintf(stderr, "ERROR: Texture of %s has image %d out of range!\n", file, t.image);
+            return -1;
+        }
+    }
+
+    // Lights are sampled as rects
+    for (int32_t light : this->lights) {
+        if (light < 0 || (size_t) light >= this->rects.size()) {
+            fprintf(stderr, "ERROR: Light %d of %s is out of range!\n", light, file);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+int Scene::save_binary(const char* file) const {
+    FILE* f = fopen(file, "wb");
+    if (!f) {
+        fprintf(stderr, "ERROR: Unable to open %s for writing!\n", file);
+        return -1;
+    }
+
+    std::string names;
+    for (const std::string &image : this->images) {
+        names += image;
+        names.push_back('\0');
+    }
+
+    const void* data[SECTION_COUNT] = {
+        this->textures.data, this->materials.data, this->spheres.data, this->rects.data,
+        this->nodes.data, this->prims.data, names.data(),
+        this->positions.data, this->normals.data, this->uvs.data, this->triangles.data,
+        this->instances.data, this->lights.data
+    };
+    size_t sizes[SECTION_COUNT] = {
+        this->textures.bytes(), this->materials.bytes(), this->spheres.bytes(), this->rects.bytes(),
+        this->nodes.bytes(), this->prims.bytes(), names.size(),
+        this->positions.bytes(), this->normals.bytes(), this->uvs.bytes(), this->triangles.bytes(),
+        this->instances.bytes(), this->lights.bytes()
+    };
+
+    SceneFileHeader header = {};
+    header.magic = RTSCENE_MAGIC;
+    header.version = RTSCENE_VERSION;
+    header.camera = this->camera;
+
+    uint64_t offset = (sizeof(SceneFileHeader) + RTSCENE_ALIGN - 1) & ~(uint64_t) (RTSCENE_ALIGN - 1);
+    for (int i = 0; i < SECTION_COUNT; i++) {
+        header.sections[i].offset = offset;
+        header.sections[i].size = sizes[i];
+        offset = (offset + sizes[i] + RTSCENE_ALIGN - 1) & ~(uint64_t) (RTSCENE_ALIGN - 1);
+    }
+
+    static const char zeros[RTSCENE_ALIGN] = { 0 };
+    bool ok = fwrite(&header, sizeof(header), 1, f) == 1;
+    uint64_t written = sizeof(header);
+    for (int i = 0; i < SECTION_COUNT && ok; i++) {
+        ok = fwrite(zeros, 1, header.sections[i].offset - written, f) == header.sections[i].offset - written;
+        ok = ok && (sizes[i] == 0 || fwrite(data[i], 1, sizes[i], f) == sizes[i]);
+        written = header.sections[i].offset + sizes[i];
+    }
+    fclose(f);
+
+    if (!ok) {
+        fprintf(stderr, "ERROR: Failed to write %s!\n", file);
+        return -1;
+    }
+    return 0;
+}
+
+void Scene::unmap() {
+    if (!this->m_map) {
+        return;
+    }
+#if defined(_WIN32) || defined(_WIN64)
+    UnmapViewOfFile(this->m_map);
+#else
+    munmap(this->m_map, this->m_map_size);
+#endif
+    this->m_map = NULL;
+    this->m_map_size = 0;
+}
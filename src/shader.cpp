@@ -1,14 +1,39 @@
 #include "shader.h"
 
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
 #include <fstream>
 #include <string>
+#include <vector>
+
+#if defined(_WIN32) || defined(_WIN64)
+#include <direct.h>
+#include <fcntl.h>
+#include <io.h>
+#include <process.h>
+#include <sys/stat.h>
+#define mkdir(dir, mode) _mkdir(dir)
+#else
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Identifies the program binary files of the cache
+#define CACHE_MAGIC 0x42505452
+
+struct CacheHeader {
+    uint32_t magic;
+    uint32_t format;
+    uint32_t size;
+};
+
+static std::string cache_dir = "shader_cache";
 
 Shader::Shader() {
     this->program = 0;
-    this->shaders[VERTEX] = 0;
-    this->shaders[FRAGMENT] = 0;
-    this->shaders[GEOMETRY] = 0;
-    this->shaders[COMPUTE] = 0;
+    this->cached = false;
 }
 
 Shader::~Shader() {
@@ -16,8 +41,24 @@ Shader::~Shader() {
     this->program = 0;
 }
 
+void Shader::set_cache_dir(const char* dir) {
+    cache_dir = dir ? dir : "";
+}
+
 int Shader::load_text(enum ShaderType type, const char *src) {
-    // Create shader
+    if (type < VERTEX || type > COMPUTE) {
+        fprintf(stderr, "ERROR: Invalid ShaderType!\n");
+        return -1;
+    }
+
+    this->sources[type] = src;
+    this->files[type].clear();
+    return 0;
+}
+
+// Compiles one stage of a program, the files its source was read from are
+// listed when it fails to compile
+static GLuint compile_stage(enum ShaderType type, const std::string &src, const std::vector<std::string> &files) {
     GLenum gl_type;
     switch(type) {
         case VERTEX:
@@ -29,17 +70,14 @@ int Shader::load_text(enum ShaderType type, const char *src) {
         case FRAGMENT:
             gl_type = GL_FRAGMENT_SHADER;
             break;
-        case COMPUTE:
+        default:
             gl_type = GL_COMPUTE_SHADER;
             break;
-        default:
-            fprintf(stderr, "ERROR: Invalid ShaderType!\n");
-            return -1;
     }
 
     GLuint gl_shader = glCreateShader(gl_type);
-    glShaderSource(gl_shader, 1, &src, NULL);
-    
+    const char* text = src.c_str();
+    glShaderSource(gl_shader, 1, &text, NULL);
 
     // Compile + error check
     int status;
@@ -52,42 +90,290 @@ int Shader::load_text(enum ShaderType type, const char *src) {
         char* log = (char*) malloc(log_size * sizeof(char));
         glGetShaderInfoLog(gl_shader, log_size, NULL, log);
         fprintf(stderr, "ERROR: Failed to compile shader! Message follows:\n%s", log);
+        for (size_t i = 0; i < files.size(); i++) {
+            fprintf(stderr, "ERROR: source string %d is %s\n", (int) i, files[i].c_str());
+        }
 
         // Clean up
         free(log);
         glDeleteShader(gl_shader);
+        return 0;
+    }
+    return gl_shader;
+}
 
-        //return code
+// Appends a shader file to out, pasting in the files named by its
+// #include "file" lines (relative to the including file, each only once).
+// #line directives keep compiler messages pointing at the right file, the
+// source string number being the file's position in files.
+static int read_source(const std::string &file, std::vector<std::string> &files, std::string &out) {
+    std::ifstream ifs(file);
+    if (!ifs) {
+        fprintf(stderr, "ERROR: Could not open shader %s\n", file.c_str());
         return -1;
     }
 
-    this->shaders[type] = gl_shader;
+    int index = (int) files.size();
+    files.push_back(file);
+    std::string dir = file.substr(0, file.find_last_of("/\\") + 1);
+
+    std::string line;
+    int number = 0;
+    while (std::getline(ifs, line)) {
+        number++;
+        size_t start = line.find_first_not_of(" \t");
+        if (start == std::string::npos || line.compare(start, 8, "#include") != 0) {
+            out += line;
+            out += '\n';
+            continue;
+        }
+
+        size_t open = line.find('"', start);
+        size_t close = open == std::string::npos ? open : line.find('"', open + 1);
+        if (close == std::string::npos) {
+            fprintf(stderr, "ERROR: %s:%d: malformed #include\n", file.c_str(), number);
+            return -1;
+        }
+
+        std::string path = dir + line.substr(open + 1, close - open - 1);
+        if (std::find(files.begin(), files.end(), path) == files.end()) {
+            out += "#line 1 " + std::to_string(files.size()) + "\n";
+            if (read_source(path, files, out)) {
+                return -1;
+            }
+        }
+        out += "#line " + std::to_string(number + 1) + " " + std::to_string(index) + "\n";
+    }
     return 0;
 }
 
 int Shader::load_file(enum ShaderType type, const char* file) {
-    std::ifstream ifs(file);
-    std::string content( 
-        (std::istreambuf_iterator<char>(ifs)),
-        (std::istreambuf_iterator<char>())
-    );
+    std::vector<std::string> files;
+    std::string content;
+    if (read_source(file, files, content)) {
+        return -1;
+    }
+
+    if (this->load_text(type, content.c_str())) {
+        return -1;
+    }
+    this->files[type] = files;
+    return 0;
+}
+
+void Shader::define(const char* name, const char* value) {
+    this->defines += std::string("#define ") + name + " " + value + "\n";
+}
+
+void Shader::define(const char* name, int value) {
+    this->define(name, std::to_string(value).c_str());
+}
+
+// Pastes defines after the #version line of a source, which has to come
+// first. The #line directive keeps the following lines numbered as before.
+static std::string with_defines(const std::string &src, const std::string &defines) {
+    if (defines.empty() || src.empty()) {
+        return src;
+    }
 
-    return this->load_text(type, content.c_str());
+    size_t start = src.find_first_not_of(" \t\r\n");
+    if (start == std::string::npos || src.compare(start, 8, "#version") != 0) {
+        return defines + "#line 1 0\n" + src;
+    }
+    size_t end = src.find('\n', start);
+    if (end == std::string::npos) {
+        return src + "\n" + defines;
+    }
+    int line = (int) std::count(src.begin(), src.begin() + end, '\n') + 2;
+    return src.substr(0, end + 1) + defines + "#line " + std::to_string(line) + " 0\n" + src.substr(end + 1);
+}
+
+// FNV-1a, extended by each call
+static uint64_t hash_bytes(uint64_t hash, const void* data, size_t size) {
+    const unsigned char* bytes = (const unsigned char*) data;
+    for (size_t i = 0; i < size; i++) {
+        hash = (hash ^ bytes[i]) * 0x100000001b3ull;
+    }
+    return hash;
+}
+
+static uint64_t hash_string(uint64_t hash, const char* s) {
+    return hash_bytes(hash, s ? s : "", s ? strlen(s) + 1 : 1);
+}
+
+// Path of a program's cache file, named after the hash of its sources and
+// of the driver that compiled it, whose binaries no other driver can load
+static std::string cache_file(const std::string* sources) {
+    uint64_t hash = 0xcbf29ce484222325ull;
+    hash = hash_string(hash, (const char*) glGetString(GL_VENDOR));
+    hash = hash_string(hash, (const char*) glGetString(GL_RENDERER));
+    hash = hash_string(hash, (const char*) glGetString(GL_VERSION));
+    for (int i = 0; i < 4; i++) {
+        hash = hash_bytes(hash, &i, sizeof(i));
+        hash = hash_string(hash, sources[i].c_str());
+    }
+
+    char name[32];
+    snprintf(name, sizeof(name), "/%016llx.bin", (unsigned long long) hash);
+    return cache_dir + name;
+}
+
+// Loads a cached program binary into program, fails if there is none or
+// the driver rejects it
+static int load_binary(GLuint program, const std::string &file) {
+    FILE* f = fopen(file.c_str(), "rb");
+    if (!f) {
+        return -1;
+    }
+
+    // The header's size must account for the rest of the file exactly,
+    // anything else is a damaged entry and not worth allocating for
+    fseek(f, 0, SEEK_END);
+    long length = ftell(f);
+    fseek(f, 0, SEEK_SET);
+
+    CacheHeader header;
+    std::vector<char> binary;
+    if (fread(&header, sizeof(header), 1, f) == 1 && header.magic == CACHE_MAGIC &&
+        length >= (long) sizeof(header) && header.size == (uint64_t) (length - (long) sizeof(header))) {
+        binary.resize(header.size);
+        if (fread(binary.data(), 1, binary.size(), f) != binary.size()) {
+            binary.clear();
+        }
+    }
+    fclose(f);
+    if (binary.empty()) {
+        return -1;
+    }
+
+    // The errors of a rejected binary must not be blamed on later calls
+    int32_t status;
+    glProgramBinary(program, header.format, binary.data(), (GLsizei) binary.size());
+    glGetProgramiv(program, GL_LINK_STATUS, &status);
+    if (!status) {
+        while (glGetError() != GL_NO_ERROR) {
+        }
+        return -1;
+    }
+    return 0;
+}
+
+// Creates a file for writing, failing if it already exists
+static FILE* create_file(const std::string &file) {
+#if defined(_WIN32) || defined(_WIN64)
+    int fd = _open(file.c_str(), _O_WRONLY | _O_CREAT | _O_EXCL | _O_BINARY, _S_IREAD | _S_IWRITE);
+    FILE* f = fd >= 0 ? _fdopen(fd, "wb") : NULL;
+    if (fd >= 0 && !f) {
+        _close(fd);
+        remove(file.c_str());
+    }
+#else
+    int fd = open(file.c_str(), O_WRONLY | O_CREAT | O_EXCL, 0644);
+    FILE* f = fd >= 0 ? fdopen(fd, "wb") : NULL;
+    if (fd >= 0 && !f) {
+        close(fd);
+        remove(file.c_str());
+    }
+#endif
+    return f;
+}
+
+// Saves a linked program's binary, through a temporary file of this process
+// so processes sharing the cache never read or write half of one
+static void save_binary(GLuint program, const std::string &file) {
+    int32_t size;
+    glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &size);
+    if (size <= 0) {
+        return;
+    }
+
+    CacheHeader header;
+    std::vector<char> binary(size);
+    GLenum format;
+    glGetProgramBinary(program, size, NULL, &format, binary.data());
+    header.magic = CACHE_MAGIC;
+    header.format = format;
+    header.size = (uint32_t) size;
+
+    mkdir(cache_dir.c_str(), 0755);
+#if defined(_WIN32) || defined(_WIN64)
+    std::string temp = file + "." + std::to_string(_getpid()) + ".tmp";
+#else
+    std::string temp = file + "." + std::to_string(getpid()) + ".tmp";
+#endif
+    FILE* f = create_file(temp);
+    if (!f) {
+        fprintf(stderr, "ERROR: Unable to write %s!\n", temp.c_str());
+        return;
+    }
+    bool written = fwrite(&header, sizeof(header), 1, f) == 1 &&
+                   fwrite(binary.data(), 1, binary.size(), f) == binary.size();
+    written = fclose(f) == 0 && written;
+    if (!written || rename(temp.c_str(), file.c_str())) {
+        fprintf(stderr, "ERROR: Unable to write %s!\n", file.c_str());
+        remove(temp.c_str());
+    }
 }
 
 int Shader::compile() {
-    // Create and attach shaders
+    std::string sources[4];
+    for (int i = 0; i < 4; i++) {
+        sources[i] = with_defines(this->sources[i], this->defines);
+    }
+
+    // Drivers may support no binary formats at all, nothing could be cached
+    int32_t formats = 0;
+    if (!cache_dir.empty() && (GLEW_VERSION_4_1 || GLEW_ARB_get_program_binary)) {
+        glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+    }
+    std::string file = formats > 0 ? cache_file(sources) : std::string();
+
     this->program = glCreateProgram();
+    this->cached = !file.empty() && !load_binary(this->program, file);
+    if (this->cached) {
+        this->find_locations();
+        return 0;
+    }
+
+    // A rejected binary may leave the program unusable, start over
+    if (!file.empty()) {
+        glDeleteProgram(this->program);
+        this->program = glCreateProgram();
+    }
+
+    // Compile and attach shaders
+    GLuint shaders[4] = { 0 };
     for (int i = 0; i < 4; i ++) {
-        if (this->shaders[i]) {
-            glAttachShader(this->program, this->shaders[i]);
+        if (sources[i].empty()) {
+            continue;
+        }
+        shaders[i] = compile_stage((ShaderType) i, sources[i], this->files[i]);
+        if (!shaders[i]) {
+            for (int j = 0; j < i; j++) {
+                glDeleteShader(shaders[j]);
+            }
+            glDeleteProgram(this->program);
+            this->program = 0;
+            return -1;
         }
+        glAttachShader(this->program, shaders[i]);
     }
 
     // Link
     int32_t status;
+    if (!file.empty()) {
+        glProgramParameteri(this->program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    }
     glLinkProgram(this->program);
     glGetProgramiv(this->program, GL_LINK_STATUS, &status);
+
+    for (int i = 0; i < 4; i ++) {
+        if (shaders[i]) {
+            glDetachShader(this->program, shaders[i]);
+            glDeleteShader(shaders[i]);
+        }
+    }
+
     if (!status) {
         // Get error and print
         int32_t log_size;
@@ -99,20 +385,59 @@ int Shader::compile() {
         // Clean up
         free(log);
         glDeleteProgram(this->program);
+        this->program = 0;
 
         //return code
         return -1;
     }
 
-    for (int i = 0; i < 4; i ++) {
-        if (this->shaders[i]) {
-            glDetachShader(this->program, this->shaders[i]);
-            glDeleteShader(this->shaders[i]);
-        }
+    if (!file.empty()) {
+        save_binary(this->program, file);
     }
+    this->find_locations();
     return 0;
 }
 
+void Shader::find_locations() {
+    int32_t count, length;
+    glGetProgramiv(this->program, GL_ACTIVE_UNIFORMS, &count);
+    glGetProgramiv(this->program, GL_ACTIVE_UNIFORM_MAX_LENGTH, &length);
+
+    this->locations.clear();
+    std::vector<char> name(length > 0 ? length : 1);
+    for (int32_t i = 0; i < count; i++) {
+        glGetActiveUniformName(this->program, i, (GLsizei) name.size(), NULL, name.data());
+
+        // Members of uniform blocks have no location
+        GLint loc = glGetUniformLocation(this->program, name.data());
+        if (loc < 0) {
+            continue;
+        }
+
+        // Arrays are listed as their first element, the other elements
+        // follow it
+        std::string uniform = name.data();
+        this->locations[uniform] = loc;
+        size_t bracket = uniform.rfind("[0]");
+        if (bracket != std::string::npos && bracket + 3 == uniform.size()) {
+            int32_t size;
+            GLenum type;
+            glGetActiveUniform(this->program, i, 0, NULL, &size, &type, NULL);
+            std::string base = uniform.substr(0, bracket);
+            this->locations[base] = loc;
+            for (int32_t j = 1; j < size; j++) {
+                std::string element = base + "[" + std::to_string(j) + "]";
+                this->locations[element] = glGetUniformLocation(this->program, element.c_str());
+            }
+        }
+    }
+}
+
+GLint Shader::location(const char* name) const {
+    auto it = this->locations.find(name);
+    return it == this->locations.end() ? -1 : it->second;
+}
+
 // void Shader::uniform_mat4(const char* name, const mat4 data) {
 //     GLuint loc = glGetUniformLocation(this->program, name);
 //     glUniformMatrix4fv(loc, 1, GL_FALSE, data);
@@ -124,23 +449,22 @@ int Shader::compile() {
 // }
 
 void Shader::uniform_vec3(const char* name, const vec3 data) {
-    GLuint loc = glGetUniformLocation(this->program, name);
-    glUniform3fv(loc, 1, data.e);
+    glUniform3fv(this->location(name), 1, data.e);
 }
 
 void Shader::uniform_float(const char* name, float data) {
-    GLuint loc = glGetUniformLocation(this->program, name);
-    glUniform1f(loc, data);
+    glUniform1f(this->location(name), data);
 }
 
 void Shader::uniform_int(const char* name, int data) {
-    GLuint loc = glGetUniformLocation(this->program, name);
-    glUniform1i(loc, data);
+    glUniform1i(this->location(name), data);
 }
 
 void Shader::bind_ubo(const char* name, uint32_t slot) {
     GLuint loc = glGetUniformBlockIndex(this->program, name);
-    glUniformBlockBinding(this->program, loc, slot);
+    if (loc != GL_INVALID_INDEX) {
+        glUniformBlockBinding(this->program, loc, slot);
+    }
 }
 
 void Shader::bind() {
@@ -0,0 +1,40 @@
+#include "sobol.h"
+
+// Joe-Kuo parameters of dimensions 1 and up: polynomial degree s, its
+// coefficients a and the initial direction integers m
+struct SobolPolynomial {
+    int s;
+    uint32_t a;
+    uint32_t m[SOBOL_DIMENSIONS];
+};
+
+static const SobolPolynomial POLYNOMIALS[SOBOL_DIMENSIONS - 1] = {
+    { 1, 0, { 1 } },
+    { 2, 1, { 1, 3 } },
+    { 3, 1, { 1, 3, 1 } },
+};
+
+void sobol_directions(uint32_t* directions) {
+
+    // The first dimension is the van der Corput sequence
+    for (int i = 0; i < SOBOL_BITS; i++) {
+        directions[i] = 1u << (31 - i);
+    }
+
+    for (int d = 1; d < SOBOL_DIMENSIONS; d++) {
+        const SobolPolynomial &p = POLYNOMIALS[d - 1];
+        uint32_t* v = directions + d * SOBOL_BITS;
+        for (int i = 0; i < SOBOL_BITS; i++) {
+            if (i < p.s) {
+                v[i] = p.m[i] << (31 - i);
+                continue;
+            }
+            v[i] = v[i - p.s] ^ (v[i - p.s] >> p.s);
+            for (int k = 1; k < p.s; k++) {
+                if ((p.a >> (p.s - 1 - k)) & 1) {
+                    v[i] ^= v[i - k];
+                }
+            }
+        }
+    }
+}